@@ -1,6 +1,139 @@
 #ifndef _TARGET_H_
 #define _TARGET_H_
 
+#if TLSF_SHM
+/* 多进程共享内存池：进程间共享的robust互斥量。持有锁的进程退出后，
+   下一个加锁者得到EOWNERDEAD，由tlsf_lock_recover()检查内存池（损坏时使其失效），
+   再标记互斥量恢复可用后继续 */
+#include <pthread.h>
+#include <errno.h>
+
+static void tlsf_lock_recover(pthread_mutex_t *l);     /* tlsf.c */
+
+#define TLSF_MLOCK_T            pthread_mutex_t
+#define TLSF_CREATE_LOCK(l)     { \
+	pthread_mutexattr_t _attr; \
+	pthread_mutexattr_init(&_attr); \
+	pthread_mutexattr_setpshared(&_attr, PTHREAD_PROCESS_SHARED); \
+	pthread_mutexattr_setrobust(&_attr, PTHREAD_MUTEX_ROBUST); \
+	pthread_mutex_init((l), &_attr); \
+	pthread_mutexattr_destroy(&_attr); \
+}
+#define TLSF_DESTROY_LOCK(l)    {pthread_mutex_destroy(l);}
+
+#define TLSF_ACQUIRE_LOCK(l)    { \
+	if (pthread_mutex_lock(l) == EOWNERDEAD) \
+		tlsf_lock_recover(l); \
+}
+
+#define TLSF_RELEASE_LOCK(l)    {pthread_mutex_unlock(l);}
+
+static __inline__ int tlsf_try_lock(pthread_mutex_t *l)
+{
+	int ret = pthread_mutex_trylock(l);
+
+	if (ret == EOWNERDEAD)
+		tlsf_lock_recover(l);
+	return ret == 0 || ret == EOWNERDEAD;
+}
+#define TLSF_TRY_LOCK(l)        tlsf_try_lock(l)
+
+#elif TLSF_PTHREAD
+/* 主机（Linux）上运行：递归pthread互斥量，与RTX的osMutexRecursive语义相同 */
+#include <pthread.h>
+
+#define TLSF_MLOCK_T            pthread_mutex_t
+#define TLSF_CREATE_LOCK(l)     { \
+	pthread_mutexattr_t _attr; \
+	pthread_mutexattr_init(&_attr); \
+	pthread_mutexattr_settype(&_attr, PTHREAD_MUTEX_RECURSIVE); \
+	pthread_mutex_init((l), &_attr); \
+	pthread_mutexattr_destroy(&_attr); \
+}
+#define TLSF_DESTROY_LOCK(l)    {pthread_mutex_destroy(l);}
+#define TLSF_ACQUIRE_LOCK(l)    {pthread_mutex_lock(l);}
+#define TLSF_RELEASE_LOCK(l)    {pthread_mutex_unlock(l);}
+#define TLSF_TRY_LOCK(l)        (pthread_mutex_trylock(l) == 0)
+
+#if TLSF_WAIT
+/* 等待内存（TLSF_WAIT）：每个等待者一个条件变量，超时单位为毫秒 */
+#include <errno.h>
+#include <time.h>
+
+typedef int tlsf_waitq_t;               /* 不需要内存池级的对象 */
+
+typedef struct tlsf_waiter_struct {
+	pthread_mutex_t m;
+	pthread_cond_t c;
+	int woken;
+	int forever;
+	struct timespec deadline;       /* CLOCK_MONOTONIC */
+} tlsf_waiter_t;
+
+#define tlsf_waitq_init(q)              (*(q) = 0)
+#define tlsf_waitq_destroy(q)           ((void) (q))
+#define TLSF_WAIT_SELF_PRIO()           (0)
+
+static __inline__ int tlsf_waiter_init(tlsf_waitq_t *q, tlsf_waiter_t *w, unsigned long timeout)
+{
+	pthread_condattr_t _attr;
+
+	(void) q;
+	pthread_condattr_init(&_attr);
+	pthread_condattr_setclock(&_attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&w->c, &_attr);
+	pthread_condattr_destroy(&_attr);
+	pthread_mutex_init(&w->m, NULL);
+	w->woken = 0;
+	w->forever = (timeout == TLSF_WAIT_FOREVER);
+	clock_gettime(CLOCK_MONOTONIC, &w->deadline);
+	w->deadline.tv_sec += timeout / 1000;
+	w->deadline.tv_nsec += (long) (timeout % 1000) * 1000000L;
+	if (w->deadline.tv_nsec >= 1000000000L) {
+		w->deadline.tv_sec++;
+		w->deadline.tv_nsec -= 1000000000L;
+	}
+	return 1;
+}
+
+static __inline__ void tlsf_waiter_destroy(tlsf_waitq_t *q, tlsf_waiter_t *w)
+{
+	(void) q;
+	pthread_cond_destroy(&w->c);
+	pthread_mutex_destroy(&w->m);
+}
+
+static __inline__ void tlsf_waiter_wake(tlsf_waitq_t *q, tlsf_waiter_t *w)
+{
+	(void) q;
+	pthread_mutex_lock(&w->m);
+	w->woken = 1;
+	pthread_cond_signal(&w->c);
+	pthread_mutex_unlock(&w->m);
+}
+
+/* 不持有内存池的锁时调用，被唤醒返回1，超时返回0 */
+static __inline__ int tlsf_waiter_sleep(tlsf_waitq_t *q, tlsf_waiter_t *w)
+{
+	int ret;
+
+	(void) q;
+	pthread_mutex_lock(&w->m);
+	while (!w->woken) {
+		if (w->forever)
+			pthread_cond_wait(&w->c, &w->m);
+		else if (pthread_cond_timedwait(&w->c, &w->m, &w->deadline) == ETIMEDOUT)
+			break;
+	}
+	ret = w->woken;
+	w->woken = 0;
+	pthread_mutex_unlock(&w->m);
+	return ret;
+}
+#endif
+
+#else
+
 
 #define TLSF_MLOCK_T            osMutexId_t
 #define TLSF_CREATE_LOCK(l)     {(*l) = osMutexNew(&TLSF_Mutex_attr);}
@@ -19,6 +152,65 @@
 
 
 
+#define TLSF_TRY_LOCK(l)        ((__get_IPSR() != 0U) || osMutexAcquire((*l), 0) == osOK)
+
+#if TLSF_WAIT
+/* 等待内存（TLSF_WAIT）：每个内存池一个事件标志组，每个等待者占用其中一位，
+   最多同时31个等待者；超时单位为内核tick */
+typedef struct tlsf_waitq_struct {
+	osEventFlagsId_t flags;
+	uint32_t busy;                  /* 已分配给等待者的位 */
+} tlsf_waitq_t;
+
+typedef struct tlsf_waiter_struct {
+	uint32_t bit;
+	int forever;
+	uint32_t deadline;              /* osKernelGetTickCount() */
+} tlsf_waiter_t;
+
+#define tlsf_waitq_init(q)              {(q)->flags = osEventFlagsNew(NULL); (q)->busy = 0;}
+#define tlsf_waitq_destroy(q)           {osEventFlagsDelete((q)->flags);}
+#define TLSF_WAIT_SELF_PRIO()           ((int) osThreadGetPriority(osThreadGetId()))
+
+/* 在内存池的锁内调用，没有空闲的标志位时返回0 */
+static __inline__ int tlsf_waiter_init(tlsf_waitq_t *q, tlsf_waiter_t *w, unsigned long timeout)
+{
+	int i;
+
+	for (i = 0; i < 31 && (q->busy & (1UL << i)); i++)
+		;
+	if (i == 31)
+		return 0;
+	w->bit = 1UL << i;
+	q->busy |= w->bit;
+	osEventFlagsClear(q->flags, w->bit);
+	w->forever = (timeout == TLSF_WAIT_FOREVER);
+	w->deadline = osKernelGetTickCount() + (uint32_t) timeout;
+	return 1;
+}
+
+static __inline__ void tlsf_waiter_destroy(tlsf_waitq_t *q, tlsf_waiter_t *w)
+{
+	q->busy &= ~w->bit;
+	osEventFlagsClear(q->flags, w->bit);    /* 离开后才到的唤醒 */
+}
+
+#define tlsf_waiter_wake(q, w)          {osEventFlagsSet((q)->flags, (w)->bit);}
+
+/* 不持有内存池的锁时调用，被唤醒返回1，超时返回0 */
+static __inline__ int tlsf_waiter_sleep(tlsf_waitq_t *q, tlsf_waiter_t *w)
+{
+	uint32_t ticks = osWaitForever;
+
+	if (!w->forever) {
+		ticks = w->deadline - osKernelGetTickCount();
+		if ((int32_t) ticks <= 0)
+			return 0;
+	}
+	return !(osEventFlagsWait(q->flags, w->bit, osFlagsWaitAny, ticks) & osFlagsError);
+}
+#endif
+
 //#define TLSF_ACQUIRE_LOCK(l)    { \
 //	if (__get_IPSR() != 0U) { \
 //	} \
@@ -38,3 +230,23 @@
 //}
 
 #endif
+
+/* 锁统计（TLSF_LOCK_STAT）使用的时钟 */
+#ifndef TLSF_LOCK_CLOCK
+#if TLSF_SHM || TLSF_PTHREAD
+#include <time.h>
+
+static __inline__ unsigned long long tlsf_lock_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned long long) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#define TLSF_LOCK_CLOCK()       tlsf_lock_clock()       /* 纳秒 */
+#else
+#define TLSF_LOCK_CLOCK()       osKernelGetSysTimerCount()  /* 内核定时器计数 */
+#endif
+#endif
+
+#endif
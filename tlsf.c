@@ -68,10 +68,22 @@
                          存储上一个内存块（prev）的物理地址吧？b2->prev_hdr = b; 
  */
 
+/* mremap() 需要 */
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include "tlsf.h"     /* TLSF_SHM 等决定函数集合的选项在其中 */
+
+/* 在主机（Linux）上运行，锁为递归pthread互斥量，不需要CMSIS RTOS */
+#ifndef TLSF_PTHREAD
+#define	TLSF_PTHREAD 	(0)
+#endif
+
+#if !TLSF_SHM && !TLSF_PTHREAD
 #include "cmsis_os2.h"                               // CMSIS RTOS header file
 #include "cmsis_armclang.h"
-
-#include "tlsf.h"
+#endif
 /*#define USE_SBRK        (0) */
 /*#define USE_MMAP        (0) */
 
@@ -80,6 +92,8 @@
 #endif
 
 #include <string.h>
+#include <stdint.h>
+#include <limits.h>
 
 #ifndef TLSF_USE_LOCKS
 #define	TLSF_USE_LOCKS 	(1)
@@ -89,6 +103,62 @@
 #define	TLSF_STATISTIC 	(1)
 #endif
 
+/* 按大小类(fl,sl)的操作计数，会使tlsf_t增大 REAL_FLI*MAX_SLI*7 个字
+   （默认参数下32位约6KB，64位约12KB），内存池要相应加大 */
+#ifndef TLSF_STATISTIC_EXT
+#define	TLSF_STATISTIC_EXT 	(0)
+#endif
+
+/* 采样式内存剖析：按平均每 interval 字节（见tlsf_profile_start）采样一次，记录调用者。
+   只剖析默认内存池（tlsf_malloc等），剖析状态是全局的，由默认内存池的锁保护 */
+#ifndef TLSF_PROFILE
+#define	TLSF_PROFILE 	(0)
+#endif
+
+#ifndef TLSF_QUICK_FLI
+#define	TLSF_QUICK_FLI 	(2)
+#endif
+
+#ifndef TLSF_QUICK_LIMIT
+#define	TLSF_QUICK_LIMIT 	(32)
+#endif
+
+/* 分配失败时回收回调的最多调用次数 */
+#ifndef TLSF_RECLAIM_RETRY
+#define	TLSF_RECLAIM_RETRY 	(3)
+#endif
+
+/* 分割空闲块时把尾部分给调用者，剩余的前部保留原块头；剩余部分仍在同一大小类时
+   不需要取出/插入空闲链表，减少分配的指令数 */
+#ifndef TLSF_TAIL_SPLIT
+#define	TLSF_TAIL_SPLIT 	(0)
+#endif
+
+/* 等待队列的顺序：0 先进先出，1 按优先级（同优先级先进先出） */
+#ifndef TLSF_WAIT_PRIO
+#define	TLSF_WAIT_PRIO 	(0)
+#endif
+
+#if TLSF_PERSIST && !TLSF_PIC
+#error "TLSF_PERSIST needs TLSF_PIC"
+#endif
+
+#if TLSF_WATERMARK && !TLSF_STATISTIC
+#error "TLSF_WATERMARK needs TLSF_STATISTIC"
+#endif
+
+#if TLSF_WATERMARK && TLSF_SHM
+#error "TLSF_WATERMARK callbacks can not be shared between processes"
+#endif
+
+#if TLSF_SHM && !TLSF_PIC
+#error "TLSF_SHM needs TLSF_PIC"
+#endif
+
+#if TLSF_WAIT && (TLSF_SHM || !TLSF_USE_LOCKS)
+#error "TLSF_WAIT needs TLSF_USE_LOCKS and can not be shared between processes"
+#endif
+
 #ifndef USE_MMAP
 #define	USE_MMAP 	(0)
 #endif
@@ -97,14 +167,78 @@
 #define	USE_SBRK 	(0)
 #endif
 
+/* 扩充的内存区是本进程私有的匿名映射/堆，文件或共享内存中的内存池链接进去后，
+   其它进程与下一次运行都访问不到 */
+#if TLSF_PIC && (USE_MMAP || USE_SBRK)
+#error "TLSF_PIC pools can not grow with USE_MMAP/USE_SBRK"
+#endif
+
+/* 向系统申请的内存区（USE_MMAP/USE_SBRK）从DEFAULT_AREA_SIZE开始每次加倍，最大到此值；
+   设为DEFAULT_AREA_SIZE即每次固定大小 */
+#ifndef TLSF_AREA_MAX
+#define	TLSF_AREA_MAX 	(1024 * 1024)
+#endif
+
+/* 完全空闲的系统内存区从内存池中拿掉后最多缓存几个，再次增长时先从缓存中取，0为立即munmap */
+#ifndef TLSF_AREA_CACHE
+#define	TLSF_AREA_CACHE 	(2)
+#endif
+
+/* 向系统申请内存区时用MAP_POPULATE一次提交全部页面（需要 USE_MMAP），
+   已有的内存池可用prefault_pool_ex()预先触碰 */
+#ifndef TLSF_PREFAULT
+#define	TLSF_PREFAULT 	(0)
+#endif
+
+/* prefault_pool_ex()最多使用的线程数（TLSF_PTHREAD/TLSF_SHM） */
+#ifndef TLSF_PREFAULT_THREADS
+#define	TLSF_PREFAULT_THREADS 	(16)
+#endif
+
+/* 只有mmap得到的内存区能单独释放，sbrk得到的不能 */
+#define	AREA_TRIM 	(USE_MMAP && !USE_SBRK)
+
+/* 不小于此值的请求不进入内存池，单独mmap一段内存（0为不使用），
+   这样的块realloc时用mremap()移动页面而不复制数据，calloc时不需要清零。需要 USE_MMAP。
+   映射长度计入所属内存池的used_size/max_size与扩展统计；它不占内存池的空闲内存，
+   不改变free_size，也不触发水位检查 */
+#ifndef TLSF_MMAP_THRESHOLD
+#define	TLSF_MMAP_THRESHOLD 	(0)
+#endif
+
+#if TLSF_MMAP_THRESHOLD && !USE_MMAP
+#error "TLSF_MMAP_THRESHOLD needs USE_MMAP"
+#endif
+
+/* 不小于此值的realloc复制/calloc清零使用非临时存储（绕过cache，不挤出正在使用的数据），
+   只在有SSE2的处理器上有效 */
+#ifndef TLSF_NT_THRESHOLD
+#define	TLSF_NT_THRESHOLD 	(256 * 1024)
+#endif
+
+/* 中断块缓存（tlsf_isr_t）栈顶防ABA标记的最少位数。一次tlsf_isr_alloc()在读栈顶与CAS之间被打断，
+   期间栈顶恰好被修改2^标记位数的整数倍次时才会出错。偏移按内存池大小占位，
+   内存池大到标记不足此位数时tlsf_isr_init()失败（32位下16位标记对应512KB的内存池） */
+#ifndef TLSF_ISR_TAG_BITS
+#define	TLSF_ISR_TAG_BITS 	(16)
+#endif
+
+/* tlsf_reserve_alloc()在对应的类用完时借用更大一类的槽。借用会占掉别的调用点预留的个数，
+   使预留不再保证各类的个数，所以默认不借用 */
+#ifndef TLSF_RESERVE_BORROW
+#define	TLSF_RESERVE_BORROW 	(0)
+#endif
+
 //osMutexAttr_t  *DYNMemMutex; 
 
+#if !TLSF_SHM && !TLSF_PTHREAD
 const osMutexAttr_t TLSF_Mutex_attr = {
   "TLSF_Mutex",                                            //lock name
    osMutexRecursive|osMutexPrioInherit|osMutexRobust,      //同一线程能多次使用 | 提升线程优先级 | 退出线程自动销毁
    NULL,
    0U    
 };
+#endif
 
 
 //osMutexId DYNMemMutex_id;
@@ -115,6 +249,16 @@ static uint8_t mem_errorno = 0;
 /*  TLSF上锁解锁函数，可以使用操作系统的内存函数，也可以如下我们自己定义函数*/
 #if TLSF_USE_LOCKS       
 #include "target.h"
+#if TLSF_LOCK_STAT
+/* 加锁/解锁经过lock_stat_acquire()/lock_stat_release()记录时间，它们再调用原来的宏 */
+static __inline__ int lock_raw_try(TLSF_MLOCK_T *l) { return TLSF_TRY_LOCK(l); }
+static __inline__ void lock_raw_acquire(TLSF_MLOCK_T *l) TLSF_ACQUIRE_LOCK(l)
+static __inline__ void lock_raw_release(TLSF_MLOCK_T *l) TLSF_RELEASE_LOCK(l)
+#undef TLSF_ACQUIRE_LOCK
+#undef TLSF_RELEASE_LOCK
+#define TLSF_ACQUIRE_LOCK(l)    lock_stat_acquire(l)
+#define TLSF_RELEASE_LOCK(l)    lock_stat_release(l)
+#endif
 #else
 #define TLSF_CREATE_LOCK(_unused_)   do{}while(0)
 #define TLSF_DESTROY_LOCK(_unused_)  do{}while(0) 
@@ -124,28 +268,138 @@ static uint8_t mem_errorno = 0;
 
 /* 统计相关的函数，主要记录使用中的动态内存大小，最大使用量*/
 #if TLSF_STATISTIC
+#if TLSF_WATERMARK
+#define	TLSF_FREE_SIZE(tlsf, _op, b)  (tlsf->free_size _op (b->size & BLOCK_SIZE) + BHDR_OVERHEAD)
+#else
+#define	TLSF_FREE_SIZE(tlsf, _op, b)  ((void) 0)
+#endif
 #define	TLSF_ADD_SIZE(tlsf, b) do {	/*分配内存块时，增加使用中内存大小*/ \
 		tlsf->used_size += (b->size & BLOCK_SIZE) + BHDR_OVERHEAD;	\
 		if (tlsf->used_size > tlsf->max_size) 						\
 			tlsf->max_size = tlsf->used_size;						\
+		TLSF_FREE_SIZE(tlsf, -=, b);							\
 		} while(0)
 
 #define	TLSF_REMOVE_SIZE(tlsf, b) do {/*释放内存块时，更新used_size*/ \
 		tlsf->used_size -= (b->size & BLOCK_SIZE) + BHDR_OVERHEAD;	\
+		TLSF_FREE_SIZE(tlsf, +=, b);							\
 	} while(0)
 #else
 #define	TLSF_ADD_SIZE(tlsf, b)	     do{}while(0)
 #define	TLSF_REMOVE_SIZE(tlsf, b)    do{}while(0)
 #endif
 
-#if USE_MMAP || USE_SBRK
+/* 扩展统计：计数都在内存池锁内更新，普通自增即可，读取时在锁内整体拷贝 */
+#if TLSF_STATISTIC_EXT
+#define	TLSF_STAT_INC(tlsf, _r, _field) do {	\
+		int _sfl, _ssl;	\
+		STAT_CLASS(_r, &_sfl, &_ssl);	\
+		tlsf->class_stat[_sfl][_ssl]._field++;	\
+	} while(0)
+
+#define	TLSF_STAT_GRANT(tlsf, _req, b) do {	/*申请大小与实际分配大小，用于统计内部碎片*/ \
+		tlsf->req_size += (_req);	\
+		tlsf->grant_size += (b->size & BLOCK_SIZE);	\
+	} while(0)
+#else
+#define	TLSF_STAT_INC(tlsf, _r, _field)     do{}while(0)
+#define	TLSF_STAT_GRANT(tlsf, _req, b)      do{}while(0)
+#endif
+
+#if TLSF_PROFILE
+/* 剖析槽位数（2的幂），采样时槽位满则丢弃该样本 */
+#ifndef TLSF_PROFILE_SLOTS
+#define	TLSF_PROFILE_SLOTS 	(64)
+#endif
+
+#if defined(__linux__)
+#include <execinfo.h>
+#endif
+
+static void profile_sample(void *ptr, size_t size, void *caller);
+static void profile_forget(void *ptr);
+static void profile_move(void *old_ptr, void *ptr, size_t size);
+
+static long prof_left = LONG_MAX;   /* 距离下次采样还剩的字节数 */
+static size_t prof_live = 0;        /* 未释放的样本个数 */
+
+/* 快速路径只有一次减法：未开启采样时 prof_left 很大，几乎不会走到 profile_sample()。
+   失败的分配不计数，否则连续失败会使 prof_left 一直减下去 */
+#define	TLSF_PROFILE_ALLOC(ptr, size) do {	\
+		if ((ptr) && (prof_left -= (long) (size)) < 0)	\
+			profile_sample((ptr), (size), __builtin_return_address(0));	\
+	} while(0)
+
+#define	TLSF_PROFILE_FREE(ptr) do {	\
+		if (prof_live)	\
+			profile_forget(ptr);	\
+	} while(0)
+
+#define	TLSF_PROFILE_MOVE(old_ptr, ptr, size) do {	\
+		if (prof_live)	\
+			profile_move((old_ptr), (ptr), (size));	\
+	} while(0)
+#else
+#define	TLSF_PROFILE_ALLOC(ptr, size)           do{}while(0)
+#define	TLSF_PROFILE_FREE(ptr)                  do{}while(0)
+#define	TLSF_PROFILE_MOVE(old_ptr, ptr, size)   do{}while(0)
+#endif
+
+/* 一次分配/释放结束后检查水位 */
+#if TLSF_WATERMARK
+#define	TLSF_WATERMARK_CHECK(tlsf) do {	\
+		if (tlsf->wm.notify)	\
+			watermark_check(tlsf);	\
+	} while(0)
+#else
+#define	TLSF_WATERMARK_CHECK(tlsf)    do{}while(0)
+#endif
+
+/* 有空闲块回到内存池后唤醒等待者 */
+#if TLSF_WAIT
+#define	TLSF_WAIT_WAKE(tlsf) do {	\
+		if (tlsf->waiters)	\
+			wake_waiters(tlsf);	\
+	} while(0)
+#else
+#define	TLSF_WAIT_WAKE(tlsf)    do{}while(0)
+#endif
+
+/* 整理游标指向的块被合并进别的块时，游标改指向合并后的块 */
+#if TLSF_HANDLE
+#define	TLSF_CURSOR_MERGED(tlsf, _victim, _into) do {	\
+		if (COMPACT_CURSOR(tlsf) == (_victim))	\
+			SET_COMPACT_CURSOR(tlsf, _into);	\
+	} while(0)
+#else
+#define	TLSF_CURSOR_MERGED(tlsf, _victim, _into)    do{}while(0)
+#endif
+
+#if USE_MMAP || USE_SBRK || TLSF_PTHREAD || TLSF_SHM || TLSF_PERSIST
 #include <unistd.h>
+#define	PREFAULT_PAGE	((size_t) sysconf(_SC_PAGESIZE))
+#else
+#define	PREFAULT_PAGE	((size_t) 4096)     /* 没有分页的MCU上只是把空闲内存写一遍 */
 #endif
 
-#if USE_MMAP
+#if USE_MMAP || TLSF_PERSIST || TLSF_SHM || TLSF_PTHREAD
 #include <sys/mman.h>
 #endif
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#if TLSF_PTHREAD || TLSF_SHM
+#include <pthread.h>        /* 锁关闭时 prefault_pool_ex() 仍用线程 */
+#endif
+
+#if TLSF_PERSIST || TLSF_SHM
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#endif
+
 #include "tlsf.h"
 
 #if !defined(__GNUC__)
@@ -166,23 +420,34 @@ static uint8_t mem_errorno = 0;
 /* Some IMPORTANT TLSF parameters */
 /* Unlike the preview TLSF versions, now they are statics */
 /*内存块理论上的最小值*/
-#define BLOCK_ALIGN (sizeof(void *) * 2)  /* 内存块对齐，内存块大小至少是2个字的大小（用于存储struct free_ptr_struct结构体）*/
+#define BLOCK_ALIGN (TLSF_BLOCK_ALIGN)  /* 内存块对齐，内存块大小至少是2个字的大小（用于存储struct free_ptr_struct结构体）*/
 
-#define MAX_FLI		(13)                 /*最大内存块的范围2的30次方到2的31次方直接*/
-#define MAX_LOG2_SLI	(5)             /*二级数，MAX_SLI表示一级索引分成多少块*/
+#define MAX_FLI		(TLSF_MAX_FLI)       /*最大内存块的范围2的30次方到2的31次方直接*/
+#define MAX_LOG2_SLI	(TLSF_MAX_LOG2_SLI)             /*二级数，MAX_SLI表示一级索引分成多少块*/
 #define MAX_SLI		(1 << MAX_LOG2_SLI)     /* MAX_SLI = 2^MAX_LOG2_SLI */
 
 
-#define FLI_OFFSET	(6)     /* tlsf structure just will manage blocks bigger */
+#define FLI_OFFSET	(TLSF_FLI_OFFSET)     /* tlsf structure just will manage blocks bigger */
 /* than 128 bytes */
-#define SMALL_BLOCK	(128)
+#define SMALL_BLOCK	(TLSF_SMALL_BLOCK)
 #define REAL_FLI	(MAX_FLI - FLI_OFFSET)  /* 数组最大值*/
 #define MIN_BLOCK_SIZE	(sizeof (free_ptr_t))    /*内存块最小值*/
+#define QUICK_MAX_SIZE	((size_t) 1 << (TLSF_QUICK_FLI + FLI_OFFSET))  /*小于此值的块释放时延迟合并*/
 #define BHDR_OVERHEAD	(sizeof (bhdr_t) - MIN_BLOCK_SIZE)  /*内存块的块头的大小*/
 #define TLSF_SIGNATURE	(0x2A59FA59)       /*TLSF动态算法的标志*/
+#define TLSF_POISON	(0xDEADFA59)       /*共享内存池被中途退出的进程损坏，不能再使用*/
+#if TLSF_SHM
+#define	POOL_POISONED(_t)	((_t)->tlsf_signature == TLSF_POISON)
+#else
+#define	POOL_POISONED(_t)	(0)
+#endif
+#define TLSF_LAYOUT_VERSION	(2)            /*tlsf_t/bhdr_t 布局变化时加1*/
+/* 内存池的布局标志：版本号 + 影响内存布局的编译选项，重新挂接内存池时必须一致 */
+#define TLSF_LAYOUT	((u32_t) ((TLSF_LAYOUT_VERSION << 24) | (TLSF_PIC << 23) | \
+			 (sizeof(void *) << 18) | sizeof(tlsf_t)))
 
 #define	PTR_MASK	(sizeof(void *) - 1) 
-#define BLOCK_SIZE	(0xFFFFFFFF - PTR_MASK) /* 用于字对齐，处理器取址*/
+#define BLOCK_SIZE	(~(size_t) PTR_MASK) /* 用于字对齐，处理器取址*/
 
 #define GET_NEXT_BLOCK(_addr, _r) ((bhdr_t *) ((char *) (_addr) + (_r)))  /*得到下一个物理相邻内存块的首地址*/
 
@@ -192,6 +457,19 @@ static uint8_t mem_errorno = 0;
 #define ROUNDDOWN_SIZE(_r)        ((_r) & ~MEM_ALIGN)               /*  _r低三位清零*/
 #define ROUNDUP(_x, _v)           ((((~(_x)) + 1) & ((_v)-1)) + (_x)) 
 
+/*  内存池能满足的请求上限（最大的一级索引之外）。更大的请求在ROUNDUP_SIZE/MAPPING_SEARCH之前
+    就拒绝，否则取整会回绕成很小的值。TLSF_MMAP_THRESHOLD时大请求单独映射，上限由mapped_alloc()检查 */
+#if SIZE_MAX > 0xFFFFFFFFu || MAX_FLI < 31
+#define POOL_MAX_REQUEST          ((size_t) 1 << MAX_FLI)
+#else
+#define POOL_MAX_REQUEST          ((size_t) 1 << 30)
+#endif
+#if TLSF_MMAP_THRESHOLD
+#define MAX_REQUEST               (SIZE_MAX / 2)
+#else
+#define MAX_REQUEST               POOL_MAX_REQUEST
+#endif
+
 #define BLOCK_STATE	(0x1)   /* 此内存块空闲，前一内存used*/
 #define PREV_STATE	(0x2)   /*与上相反*/
 
@@ -203,6 +481,11 @@ static uint8_t mem_errorno = 0;
 #define PREV_FREE	(0x2)
 #define PREV_USED	(0x0)
 
+/* bit 2 of the block size：单独mmap的块（内存池中的块大小都是8的倍数，此位总为0），
+   此时size为整个映射的长度 */
+#define MAPPED_BLOCK	(0x4)
+#define MAPPED_MASK	((size_t) 0x7)
+
 
 #define DEFAULT_AREA_SIZE (1024*10)
 
@@ -225,16 +508,71 @@ static uint8_t mem_errorno = 0;
 #endif
 
 typedef unsigned int u32_t;     /* NOTE: Make sure that this type is 4 bytes long on your computer */
+typedef unsigned long long u64_t; /* NOTE: Make sure that this type is 8 bytes long on your computer */
 typedef unsigned char u8_t;     /* NOTE: Make sure that this type is 1 byte on your computer */
 
+/* 位图类型：大内存池模式下一级索引超过32个，位图使用64位 */
+#if TLSF_LARGE_HEAP
+typedef u64_t bitmap_t;
+#define BITMAP_LOG2	(6)
+#else
+typedef u32_t bitmap_t;
+#define BITMAP_LOG2	(5)
+#endif
+#define BITMAP_MASK	((1 << BITMAP_LOG2) - 1)
+
+#if TLSF_LARGE_HEAP && SIZE_MAX <= 0xFFFFFFFFu
+#error "TLSF_LARGE_HEAP needs a 64 bit size_t"
+#endif
+
+#if REAL_FLI >= (1 << BITMAP_LOG2) || MAX_SLI > (1 << BITMAP_LOG2)
+#error "TLSF_MAX_FLI is too big for the bitmap, set TLSF_LARGE_HEAP"
+#endif
+
+#if TLSF_QUICKLIST && TLSF_QUICK_FLI > REAL_FLI
+#error "TLSF_QUICK_FLI is bigger than the first-level range"
+#endif
+
+/* 内存池内部的链接（prev_hdr、空闲链表、area链表、matrix）。
+   TLSF_PIC 时存放相对于字段自身地址的偏移（0 为 NULL），内存池映射到任何地址都有效；
+   否则就是普通指针，以下宏直接展开为原来的访问 */
+#if TLSF_PIC
+#define LINK_T(type)            ptrdiff_t
+#define LINK_GET(type, field)   ((field) ? (type *) ((char *) &(field) + (field)) : (type *) NULL)
+#define LINK_SET(field, val)    ((field) = (val) ? (char *) (val) - (char *) &(field) : 0)
+#else
+#define LINK_T(type)            type *
+#define LINK_GET(type, field)   (field)
+#define LINK_SET(field, val)    ((field) = (val))
+#endif
+
+#define PREV_HDR(_b)                LINK_GET(bhdr_t, (_b)->prev_hdr)
+#define SET_PREV_HDR(_b, _v)        LINK_SET((_b)->prev_hdr, _v)
+#define FREE_PREV(_b)               LINK_GET(bhdr_t, (_b)->ptr.free_ptr.prev)
+#define SET_FREE_PREV(_b, _v)       LINK_SET((_b)->ptr.free_ptr.prev, _v)
+#define FREE_NEXT(_b)               LINK_GET(bhdr_t, (_b)->ptr.free_ptr.next)
+#define SET_FREE_NEXT(_b, _v)       LINK_SET((_b)->ptr.free_ptr.next, _v)
+#define MATRIX(_t, _fl, _sl)        LINK_GET(bhdr_t, (_t)->matrix[_fl][_sl])
+#define SET_MATRIX(_t, _fl, _sl, _v) LINK_SET((_t)->matrix[_fl][_sl], _v)
+#define QUICK(_t, _fl, _sl)         LINK_GET(bhdr_t, (_t)->quick[_fl][_sl])
+#define SET_QUICK(_t, _fl, _sl, _v) LINK_SET((_t)->quick[_fl][_sl], _v)
+#define AREA_HEAD(_t)               LINK_GET(area_info_t, (_t)->area_head)
+#define SET_AREA_HEAD(_t, _v)       LINK_SET((_t)->area_head, _v)
+#define AREA_NEXT(_a)               LINK_GET(area_info_t, (_a)->next)
+#define SET_AREA_NEXT(_a, _v)       LINK_SET((_a)->next, _v)
+#define AREA_END(_a)                LINK_GET(bhdr_t, (_a)->end)
+#define SET_AREA_END(_a, _v)        LINK_SET((_a)->end, _v)
+#define COMPACT_CURSOR(_t)          LINK_GET(bhdr_t, (_t)->cursor)
+#define SET_COMPACT_CURSOR(_t, _v)  LINK_SET((_t)->cursor, _v)
+
 typedef struct free_ptr_struct {
-    struct bhdr_struct *prev;
-    struct bhdr_struct *next;
+    LINK_T(struct bhdr_struct) prev;
+    LINK_T(struct bhdr_struct) next;
 } free_ptr_t;
 
 typedef struct bhdr_struct {
     /* This pointer is just valid if the first bit of size is set */
-    struct bhdr_struct *prev_hdr;
+    LINK_T(struct bhdr_struct) prev_hdr;
     /* The size is stored in bytes ，size之后归此bhdr_t控制块管理的内存块大小*/
     size_t size;                /* bit 0 indicates whether the block is used and */
     /* bit 1 allows to know whether the previous block is free */
@@ -250,18 +588,56 @@ typedef struct bhdr_struct {
 
 /*由于连接多个内存区，*/
 typedef struct area_info_struct {
-    bhdr_t *end;         /*指向末内存块*/
-    struct area_info_struct *next;  /*指向下一个内存区，新增的内存*/
+    LINK_T(bhdr_t) end;         /*指向末内存块*/
+    LINK_T(struct area_info_struct) next;  /*指向下一个内存区，新增的内存*/
+#if AREA_TRIM
+    size_t sys;                 /*整个内存区都由get_new_area()得到时为其长度，否则为0*/
+#endif
 } area_info_t;
 
+#if TLSF_HANDLE
+/* 句柄表项：ptr 为NULL表示空闲，此时 pin 为下一个空闲表项的序号 */
+typedef struct hentry_struct {
+    LINK_T(void) ptr;
+    int pin;
+} hentry_t;
+#endif
+
+#if TLSF_WAIT
+/* malloc_wait_ex()中睡眠的任务，节点在等待者自己的栈上 */
+typedef struct waiter_struct {
+    struct waiter_struct *next;
+    int fl, sl;                 /* MAPPING_SEARCH 得到的大小类 */
+    int prio;
+    int signalled;              /* 已唤醒，还没有重新尝试分配 */
+    tlsf_waiter_t wait;
+} waiter_t;
+#endif
+
 typedef struct TLSF_struct {
     /* the TLSF's structure signature */
     u32_t tlsf_signature;
+    /* TLSF_LAYOUT of the code that built this pool */
+    u32_t tlsf_layout;
+
+#if TLSF_PIC
+    /* Size given to init_memory_pool and an application root object,
+     * so a pool mapped again can find its data */
+    size_t pool_size;
+    LINK_T(void) root;
+#endif
 
 #if TLSF_USE_LOCKS
     TLSF_MLOCK_T lock;
 #endif
 
+#if TLSF_LOCK_STAT
+    /* Written only while the lock is held */
+    tlsf_lock_stat_t lock_stat;
+    int lock_depth;
+    unsigned long long lock_time;   /* TLSF_LOCK_CLOCK() when the lock was taken */
+#endif
+
 #if TLSF_STATISTIC
     /* These can not be calculated outside tlsf because we
      * do not know the sizes when freeing/reallocing memory. */
@@ -269,33 +645,150 @@ typedef struct TLSF_struct {
     size_t max_size;
 #endif
 
+#if TLSF_STATISTIC_EXT
+    size_t req_size;
+    size_t grant_size;
+    tlsf_class_stat_t class_stat[REAL_FLI][MAX_SLI];
+#endif
+
+#if TLSF_HANDLE
+    /* Handle table (allocated from the pool) and the compaction cursor */
+    LINK_T(hentry_t) htab;
+    int hcount;
+    int hfree;
+    LINK_T(bhdr_t) cursor;
+    LINK_T(area_info_t) cursor_area;
+#endif
+
+#if TLSF_WATERMARK
+    /* Free bytes (headers included), the watermarks and the crossed ones */
+    size_t free_size;
+    tlsf_watermark_t wm;
+    int wm_state;
+#endif
+
+#if TLSF_WAIT
+    /* Tasks sleeping in malloc_wait_ex(), in wake up order */
+    waiter_t *waiters;
+    tlsf_waitq_t waitq;
+#endif
+
+    /* Blocks cut by warm_pool_ex() and not yet merged with their free neighbours */
+    int warm_cnt;
+
+#if TLSF_QUICKLIST
+    /* Freed but not yet merged blocks (still marked used), by size class */
+    int quick_cnt;
+    LINK_T(bhdr_t) quick[TLSF_QUICK_FLI][MAX_SLI];
+#endif
+
+#if USE_MMAP || USE_SBRK
+    /* Size of the next area asked from the system (0: DEFAULT_AREA_SIZE) */
+    size_t area_next;
+    size_t sys_calls;           /* sbrk/mmap/munmap done for areas */
+    size_t sys_saved;           /* estimate of the calls avoided, see tlsf_stat_t */
+#if AREA_TRIM && TLSF_AREA_CACHE
+    int area_cached;
+    struct {
+        void *area;
+        size_t size;
+    } area_cache[TLSF_AREA_CACHE];
+#endif
+#endif
+
     /* A linked list holding all the existing areas */
-    area_info_t *area_head;
+    LINK_T(area_info_t) area_head;
 
     /* the first-level bitmap */
     /* This array should have a size of REAL_FLI bits */
-    u32_t fl_bitmap;
+    bitmap_t fl_bitmap;
 
     /* the second-level bitmap */
-    u32_t sl_bitmap[REAL_FLI];
+    bitmap_t sl_bitmap[REAL_FLI];
 
-    bhdr_t *matrix[REAL_FLI][MAX_SLI];
+    LINK_T(bhdr_t) matrix[REAL_FLI][MAX_SLI];
 } tlsf_t;
 
 
 /******************************************************************/
 /**************     Helping functions    **************************/
 /******************************************************************/
-static __inline__ void set_bit(int nr, u32_t * addr);
-static __inline__ void clear_bit(int nr, u32_t * addr);
-static __inline__ int ls_bit(int x);
-static __inline__ int ms_bit(int x);
+static __inline__ void set_bit(int nr, bitmap_t * addr);
+static __inline__ void clear_bit(int nr, bitmap_t * addr);
+static __inline__ int ls_bit(bitmap_t x);
+static __inline__ int ms_bit(size_t x);
 static __inline__ void MAPPING_SEARCH(size_t * _r, int *_fl, int *_sl);
 static __inline__ void MAPPING_INSERT(size_t _r, int *_fl, int *_sl);
 static __inline__ bhdr_t *FIND_SUITABLE_BLOCK(tlsf_t * _tlsf, int *_fl, int *_sl);
 static __inline__ bhdr_t *process_area(void *area, size_t size);
+static bhdr_t *merge_block(tlsf_t *tlsf, bhdr_t *b);
+static bhdr_t *carve_tail(tlsf_t *tlsf, bhdr_t *b, size_t size, int fl, int sl);
+static void resize_in_place(tlsf_t *tlsf, bhdr_t *b, size_t new_size);
+static int warm_merge(tlsf_t *tlsf);
+#if TLSF_QUICKLIST
+static int quick_flush(tlsf_t *tlsf);
+#endif
+#if TLSF_WATERMARK
+static void watermark_check(tlsf_t *tlsf);
+#endif
+#if TLSF_WAIT
+static void wake_waiters(tlsf_t *tlsf);
+#endif
 #if USE_SBRK || USE_MMAP
 static __inline__ void *get_new_area(size_t * size);
+static size_t grow_pool(tlsf_t *tlsf, size_t size);
+#endif
+#if AREA_TRIM
+static void trim_area(tlsf_t *tlsf, bhdr_t *b);
+#endif
+static size_t add_area(void *area, size_t area_size, void *mem_pool, size_t sys);
+
+#if TLSF_LOCK_STAT
+#define LOCK_OWNER(_l)  ((tlsf_t *) ((char *) (_l) - offsetof(tlsf_t, lock)))
+
+/*  先试着加锁，失败才算一次竞争并计时等待；递归加锁只统计最外层*/
+static __inline__ void lock_stat_acquire(TLSF_MLOCK_T *l)
+{
+    tlsf_t *tlsf = LOCK_OWNER(l);
+    tlsf_lock_stat_t *st = &tlsf->lock_stat;
+    unsigned long long t0, wait;
+    int i;
+
+    if (lock_raw_try(l)) {
+        if (tlsf->lock_depth++)
+            return;
+        tlsf->lock_time = TLSF_LOCK_CLOCK();
+    } else {
+        t0 = TLSF_LOCK_CLOCK();
+        lock_raw_acquire(l);
+        tlsf->lock_time = TLSF_LOCK_CLOCK();
+        tlsf->lock_depth++;
+        wait = tlsf->lock_time - t0;
+        st->contended_cnt++;
+        st->wait_time += wait;
+        if (wait > st->wait_max)
+            st->wait_max = wait;
+        for (i = 0; i < TLSF_LOCK_HIST - 1 && (wait >> (i + 1)); i++)
+            ;
+        st->wait_hist[i]++;
+    }
+    st->acquire_cnt++;
+}
+
+static __inline__ void lock_stat_release(TLSF_MLOCK_T *l)
+{
+    tlsf_t *tlsf = LOCK_OWNER(l);
+    tlsf_lock_stat_t *st = &tlsf->lock_stat;
+    unsigned long long hold;
+
+    if (!--tlsf->lock_depth) {
+        hold = TLSF_LOCK_CLOCK() - tlsf->lock_time;
+        st->hold_time += hold;
+        if (hold > st->hold_max)
+            st->hold_max = hold;
+    }
+    lock_raw_release(l);
+}
 #endif
 
 /*  数组[256] 索引值（下标）的最高有效值的位置*/
@@ -327,35 +820,51 @@ static const int table[] = {
 };
 
 /*  求数值最低有效位的位置（二进制）*/
-static __inline__ int ls_bit(int i)
+static __inline__ int ls_bit(bitmap_t i)
 {
-    unsigned int a;
-    unsigned int x = i & -i;  /*  x 值 = i只保留最低有效位，其它位清零 */
+    unsigned int a, b = 0;
+    unsigned int x;
+
+#if TLSF_LARGE_HEAP
+    if (!(u32_t) i && i) {    /*  低32位为0，在高32位中查找 */
+        i >>= 32;
+        b = 32;
+    }
+#endif
+    x = (unsigned int) (i & -i);  /*  x 值 = i只保留最低有效位，其它位清零 */
 
     a = x <= 0xffff ? (x <= 0xff ? 0 : 8) : (x <= 0xffffff ? 16 : 24);
-    return table[x >> a] + a;
+    return table[x >> a] + a + b;
 }
 
 /*  求数值最高有效位的位置（二进制）*/
-static __inline__ int ms_bit(int i)
+static __inline__ int ms_bit(size_t i)
 {
-    unsigned int a;
-    unsigned int x = (unsigned int) i;
+    unsigned int a, b = 0;
+    unsigned int x;
+
+#if SIZE_MAX > 0xFFFFFFFFu
+    if (i >> 32) {            /*  高32位非0，只看高32位（64位size_t总要看，超大的请求才能被拒绝） */
+        i >>= 32;
+        b = 32;
+    }
+#endif
+    x = (unsigned int) i;
 
     a = x <= 0xffff ? (x <= 0xff ? 0 : 8) : (x <= 0xffffff ? 16 : 24);
-    return table[x >> a] + a;
+    return table[x >> a] + a + b;
 }
 
-/*  addr[nr >> 5] 中的第nr位置1 （通常nr==[0 31]，则(nr >> 5)==0，如果nr>=32，则二级分割成nr位）  */
-static __inline__ void set_bit(int nr, u32_t * addr)
+/*  addr[nr >> BITMAP_LOG2] 中的第nr位置1 （通常nr小于位图位数，则(nr >> BITMAP_LOG2)==0）  */
+static __inline__ void set_bit(int nr, bitmap_t * addr)
 {
-    addr[nr >> 5] |= 1 << (nr & 0x1f);
+    addr[nr >> BITMAP_LOG2] |= (bitmap_t) 1 << (nr & BITMAP_MASK);
 }
 
-/*  addr[nr >> 5] 中的第nr位清0 （通常nr==[0 31]，则(nr >> 5)==0）  */
-static __inline__ void clear_bit(int nr, u32_t * addr)
+/*  addr[nr >> BITMAP_LOG2] 中的第nr位清0  */
+static __inline__ void clear_bit(int nr, bitmap_t * addr)
 {
-    addr[nr >> 5] &= ~(1 << (nr & 0x1f));
+    addr[nr >> BITMAP_LOG2] &= ~((bitmap_t) 1 << (nr & BITMAP_MASK));
 }
 
 /*  根据所需内存大小* _r计算出fl（一级）与sl（二级）的值，
@@ -364,13 +873,13 @@ static __inline__ void clear_bit(int nr, u32_t * addr)
 */
 static __inline__ void MAPPING_SEARCH(size_t * _r, int *_fl, int *_sl)
 {
-    int _t;
+    size_t _t;
 
     if (*_r < SMALL_BLOCK) {                          /*  所需内存块小于系统设置的最小内存块时，所需内存块在一级0 */
         *_fl = 0;                                     /*  一级索引为0，二级索引 */
         *_sl = *_r / (SMALL_BLOCK / MAX_SLI);         /*  二级是把128byte等分为MAX_SLI 份*/
     } else {
-        _t = (1 << (ms_bit(*_r) - MAX_LOG2_SLI)) - 1; /* _t =  2的ms_bit(*_r)次方/2的ms_bit(*_r)次方-1,
+        _t = ((size_t) 1 << (ms_bit(*_r) - MAX_LOG2_SLI)) - 1; /* _t =  2的ms_bit(*_r)次方/2的ms_bit(*_r)次方-1,
 		                                               得到此fl级的二级链表的内存块分割值，即此一级fl中内存块递增值*/
         *_r = *_r + _t;                             /*  需求内存值*_r + 此一级内存块递增值_t = 二级下一个内存链表内存块大小，
 		                                              便于求取满足需求内存的索引值*/
@@ -398,20 +907,32 @@ static __inline__ void MAPPING_INSERT(size_t _r, int *_fl, int *_sl)
     }
 }
 
+#if TLSF_STATISTIC_EXT
+/*  统计用的分类：即大小_r所在的(fl,sl)，超出范围的归入最后一类*/
+static __inline__ void STAT_CLASS(size_t _r, int *_fl, int *_sl)
+{
+    MAPPING_INSERT(_r, _fl, _sl);
+    if (*_fl >= REAL_FLI) {
+        *_fl = REAL_FLI - 1;
+        *_sl = MAX_SLI - 1;
+    }
+}
+#endif
+
 /*  查找合适内存块的链表表头*/
 static __inline__ bhdr_t *FIND_SUITABLE_BLOCK(tlsf_t * _tlsf, int *_fl, int *_sl)
 {
-    u32_t _tmp = _tlsf->sl_bitmap[*_fl] & (~0 << *_sl);  /*  屏蔽sl_bitmap[*_fl]中的低*_sl位，在此级中寻找空闲块的二级索引*/
+    bitmap_t _tmp = _tlsf->sl_bitmap[*_fl] & (~(bitmap_t) 0 << *_sl);  /*  屏蔽sl_bitmap[*_fl]中的低*_sl位，在此级中寻找空闲块的二级索引*/
     bhdr_t *_b = NULL;
 
     if (_tmp) {                    /*  此级有空闲内存块 */
         *_sl = ls_bit(_tmp);       /*  得到二级索引值 */
-        _b = _tlsf->matrix[*_fl][*_sl];   /*  得到空闲内存块链表的表头*/
+        _b = MATRIX(_tlsf, *_fl, *_sl);   /*  得到空闲内存块链表的表头*/
     } else {                              /*  如果此一级索引中无空闲内存块，一级的下一索引中查找*/
-        *_fl = ls_bit(_tlsf->fl_bitmap & (~0 << (*_fl + 1)));   /*  屏蔽_tlsf->fl_bitmap中的低(*_fl + 1)位，在一级中寻找空闲块的1级索引*/
+        *_fl = ls_bit(_tlsf->fl_bitmap & (~(bitmap_t) 0 << (*_fl + 1)));   /*  屏蔽_tlsf->fl_bitmap中的低(*_fl + 1)位，在一级中寻找空闲块的1级索引*/
         if (*_fl > 0) {         /* likely */                  
             *_sl = ls_bit(_tlsf->sl_bitmap[*_fl]);             /*  在*_fl中查找空闲内存二级索引值*_sl */
-            _b = _tlsf->matrix[*_fl][*_sl];                    /*  得到空闲内存块链表的表头*/
+            _b = MATRIX(_tlsf, *_fl, *_sl);                    /*  得到空闲内存块链表的表头*/
         }
     }
     return _b;
@@ -422,43 +943,43 @@ static __inline__ bhdr_t *FIND_SUITABLE_BLOCK(tlsf_t * _tlsf, int *_fl, int *_sl
     并根据新表头更新位图的标志位，准确表示此链表中有无空闲内存块    
 */
 #define EXTRACT_BLOCK_HDR(_b, _tlsf, _fl, _sl) do {					\
-		_tlsf -> matrix [_fl] [_sl] = _b -> ptr.free_ptr.next;		\
-		if (_tlsf -> matrix[_fl][_sl])	/*新表头非空*/				\
-			_tlsf -> matrix[_fl][_sl] -> ptr.free_ptr.prev = NULL;	\
+		SET_MATRIX(_tlsf, _fl, _sl, FREE_NEXT(_b));		\
+		if (MATRIX(_tlsf, _fl, _sl))	/*新表头非空*/				\
+			SET_FREE_PREV(MATRIX(_tlsf, _fl, _sl), NULL);	\
 		else { /*新表头为空，即此链表无空闲内存块，更新位图标志位*/		         				\
 			clear_bit (_sl, &_tlsf -> sl_bitmap [_fl]);				\
 			if (!_tlsf -> sl_bitmap [_fl])							\
 				clear_bit (_fl, &_tlsf -> fl_bitmap);				\
 		}															\
-		_b -> ptr.free_ptr.prev =  NULL;/*清暂时不用的指针，编程的习惯*/	\
-		_b -> ptr.free_ptr.next =  NULL;				\
+		SET_FREE_PREV(_b, NULL);/*清暂时不用的指针，编程的习惯*/	\
+		SET_FREE_NEXT(_b, NULL);				\
 	}while(0)
 
 /*  （删除_b内存块）提取内存块，并根据内存块在链表中的位置调整空闲链表与位图标志位*/
 #define EXTRACT_BLOCK(_b, _tlsf, _fl, _sl) do {							\
-		if (_b -> ptr.free_ptr.next)/*next非空，连接其后的内存块*/		\
-			_b -> ptr.free_ptr.next -> ptr.free_ptr.prev = _b -> ptr.free_ptr.prev; \
-		if (_b -> ptr.free_ptr.prev)									\
-			_b -> ptr.free_ptr.prev -> ptr.free_ptr.next = _b -> ptr.free_ptr.next; \
-		if (_tlsf -> matrix [_fl][_sl] == _b) {	/*此内存块为表头则做如下处理*/   	\
-			_tlsf -> matrix [_fl][_sl] = _b -> ptr.free_ptr.next;		\
-			if (!_tlsf -> matrix [_fl][_sl]) {	/*更新位图标志位*/						\
+		if (FREE_NEXT(_b))/*next非空，连接其后的内存块*/		\
+			SET_FREE_PREV(FREE_NEXT(_b), FREE_PREV(_b)); \
+		if (FREE_PREV(_b))									\
+			SET_FREE_NEXT(FREE_PREV(_b), FREE_NEXT(_b)); \
+		if (MATRIX(_tlsf, _fl, _sl) == _b) {	/*此内存块为表头则做如下处理*/   	\
+			SET_MATRIX(_tlsf, _fl, _sl, FREE_NEXT(_b));		\
+			if (!MATRIX(_tlsf, _fl, _sl)) {	/*更新位图标志位*/						\
 				clear_bit (_sl, &_tlsf -> sl_bitmap[_fl]);				\
 				if (!_tlsf -> sl_bitmap [_fl])							\
 					clear_bit (_fl, &_tlsf -> fl_bitmap);				\
 			}															\
 		}																\
-		_b -> ptr.free_ptr.prev = NULL;					\
-		_b -> ptr.free_ptr.next = NULL;					\
+		SET_FREE_PREV(_b, NULL);					\
+		SET_FREE_NEXT(_b, NULL);					\
 	} while(0)
 
 /*  插入内存块，且总是查入表头*/
 #define INSERT_BLOCK(_b, _tlsf, _fl, _sl) do {							\
-		_b -> ptr.free_ptr.prev = NULL;  /* 插入表头，则前项指针为空*/ \
-		_b -> ptr.free_ptr.next = _tlsf -> matrix [_fl][_sl]; \
-		if (_tlsf -> matrix [_fl][_sl])	/*若原链表非空，原表头的前项指针指向_b内存块，以形成双向链表*/	\
-			_tlsf -> matrix [_fl][_sl] -> ptr.free_ptr.prev = _b;		\
-		_tlsf -> matrix [_fl][_sl] = _b;								\
+		SET_FREE_PREV(_b, NULL);  /* 插入表头，则前项指针为空*/ \
+		SET_FREE_NEXT(_b, MATRIX(_tlsf, _fl, _sl)); \
+		if (MATRIX(_tlsf, _fl, _sl))	/*若原链表非空，原表头的前项指针指向_b内存块，以形成双向链表*/	\
+			SET_FREE_PREV(MATRIX(_tlsf, _fl, _sl), _b);		\
+		SET_MATRIX(_tlsf, _fl, _sl, _b);								\
 		set_bit (_sl, &_tlsf -> sl_bitmap [_fl]);/*更新位图标志位*/		\
 		set_bit (_fl, &_tlsf -> fl_bitmap);								\
 	} while(0)
@@ -484,11 +1005,113 @@ static __inline__ void *get_new_area(size_t * size)
 
 #if USE_MMAP
     *size = ROUNDUP(*size, PAGE_SIZE);
-    if ((area = mmap(0, *size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)) != MAP_FAILED)
+    if ((area = mmap(0, *size, PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | (TLSF_PREFAULT ? MAP_POPULATE : 0), -1, 0)) != MAP_FAILED)
         return area;
 #endif
     return ((void *) ~0);
 }
+
+/*  内存池中没有size字节的空闲块时增加一个内存区：先从缓存中取最小的够用的一个，
+    否则向系统申请，大小从DEFAULT_AREA_SIZE起每次加倍直到TLSF_AREA_MAX。
+    返回新增的空闲字节数，0表示系统内存不足*/
+static size_t grow_pool(tlsf_t *tlsf, size_t size)
+{
+    size_t need = size + BHDR_OVERHEAD * 8;     /* size plus enough room for the requered headers. */
+    size_t area_size, fixed, saved;
+    void *area;
+#if AREA_TRIM && TLSF_AREA_CACHE
+    int i, j = -1;
+
+    for (i = 0; i < tlsf->area_cached; i++)
+        if (tlsf->area_cache[i].size >= need && (j < 0 || tlsf->area_cache[i].size < tlsf->area_cache[j].size))
+            j = i;
+    if (j >= 0) {
+        area = tlsf->area_cache[j].area;
+        area_size = tlsf->area_cache[j].size;
+        tlsf->area_cache[j] = tlsf->area_cache[--tlsf->area_cached];
+        tlsf->sys_saved += 2;   /* 拿掉时的munmap与这次的mmap */
+        return add_area(area, area_size, tlsf, area_size);
+    }
+#endif
+
+    if (!tlsf->area_next)
+        tlsf->area_next = DEFAULT_AREA_SIZE;
+    area_size = (need > tlsf->area_next) ? need : tlsf->area_next;
+    fixed = (need > DEFAULT_AREA_SIZE) ? need : DEFAULT_AREA_SIZE;
+    saved = (area_size - 1) / fixed;        /* 每次固定大小时要多做的调用 */
+    area = get_new_area(&area_size);        /* Call sbrk or mmap */
+    if (area == ((void *) ~0))
+        return 0;               /* Not enough system memory */
+    tlsf->sys_calls++;
+    tlsf->sys_saved += saved;
+    if (tlsf->area_next < TLSF_AREA_MAX)
+        tlsf->area_next = (tlsf->area_next * 2 < TLSF_AREA_MAX) ? tlsf->area_next * 2 : TLSF_AREA_MAX;
+    return add_area(area, area_size, tlsf, AREA_TRIM ? area_size : 0);
+}
+#endif
+
+#if AREA_TRIM
+/*  刚合并好的空闲块b后面就是内存区的哨兵块时，如果b是get_new_area()得到的内存区中唯一的块，
+    把整个内存区从内存池中拿掉，放入缓存或者munmap*/
+static void trim_area(tlsf_t *tlsf, bhdr_t *b)
+{
+    bhdr_t *lb = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
+    area_info_t *ai, *prev = NULL;
+    void *area;
+    size_t size;
+    int fl, sl;
+#if TLSF_AREA_CACHE
+    int i, j;
+#endif
+
+#if TLSF_WAIT
+    if (tlsf->waiters)          /* 留给等待者 */
+        return;
+#endif
+    for (ai = AREA_HEAD(tlsf); ai && AREA_END(ai) != lb; ai = AREA_NEXT(ai))
+        prev = ai;
+    if (!ai || !ai->sys)
+        return;
+    area = (char *) ai - BHDR_OVERHEAD;
+    if (GET_NEXT_BLOCK(ai, ((bhdr_t *) area)->size & BLOCK_SIZE) != b)
+        return;                 /* 前面还有已用块 */
+
+    MAPPING_INSERT(b->size & BLOCK_SIZE, &fl, &sl);
+    EXTRACT_BLOCK(b, tlsf, fl, sl);
+#if TLSF_STATISTIC
+    tlsf->used_size += (b->size & BLOCK_SIZE) + BHDR_OVERHEAD;  /* 加回add_area()中free_ex()减去的 */
+    TLSF_FREE_SIZE(tlsf, -=, b);
+#endif
+    if (prev)
+        SET_AREA_NEXT(prev, AREA_NEXT(ai));
+    else
+        SET_AREA_HEAD(tlsf, AREA_NEXT(ai));
+#if TLSF_HANDLE
+    SET_COMPACT_CURSOR(tlsf, NULL);
+#endif
+    size = ai->sys;
+
+#if TLSF_AREA_CACHE
+    if (tlsf->area_cached < TLSF_AREA_CACHE) {
+        tlsf->area_cache[tlsf->area_cached].area = area;
+        tlsf->area_cache[tlsf->area_cached++].size = size;
+        return;
+    }
+    for (i = 1, j = 0; i < TLSF_AREA_CACHE; i++)   /* 缓存满了，释放最小的一个 */
+        if (tlsf->area_cache[i].size < tlsf->area_cache[j].size)
+            j = i;
+    if (tlsf->area_cache[j].size < size) {
+        munmap(tlsf->area_cache[j].area, tlsf->area_cache[j].size);
+        tlsf->area_cache[j].area = area;
+        tlsf->area_cache[j].size = size;
+    } else
+        munmap(area, size);
+#else
+    munmap(area, size);
+#endif
+    tlsf->sys_calls++;
+}
 #endif
 
 /*
@@ -537,13 +1160,17 @@ static __inline__ bhdr_t *process_area(void *area, size_t size)
          MIN_BLOCK_SIZE) ? MIN_BLOCK_SIZE : ROUNDUP_SIZE(sizeof(area_info_t)) | USED_BLOCK | PREV_USED;
     b = (bhdr_t *) GET_NEXT_BLOCK(ib->ptr.buffer, ib->size & BLOCK_SIZE);
     b->size = ROUNDDOWN_SIZE(size - 3 * BHDR_OVERHEAD - (ib->size & BLOCK_SIZE)) | USED_BLOCK | PREV_USED;
-    b->ptr.free_ptr.prev = b->ptr.free_ptr.next = 0;
+    SET_FREE_PREV(b, NULL);
+    SET_FREE_NEXT(b, NULL);
     lb = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
-    lb->prev_hdr = b;
+    SET_PREV_HDR(lb, b);
     lb->size = 0 | USED_BLOCK | PREV_FREE;
     ai = (area_info_t *) ib->ptr.buffer;
-    ai->next = 0;
-    ai->end = lb;
+    SET_AREA_NEXT(ai, NULL);
+    SET_AREA_END(ai, lb);
+#if AREA_TRIM
+    ai->sys = 0;
+#endif
     return ib;
 }
 
@@ -575,11 +1202,24 @@ size_t init_memory_pool(size_t mem_pool_size, void *mem_pool)
     }
     tlsf = (tlsf_t *) mem_pool;   /*此内存区，如果是上电初始化，则内存区为空*/
     /* Check if already initialised 此内存池已经初始化了*/
-    if (tlsf->tlsf_signature == TLSF_SIGNATURE) {/* 销毁此内存区（内存池）时，tlsf_signature赋值0*/
+    if (tlsf->tlsf_signature == TLSF_SIGNATURE && tlsf->tlsf_layout == TLSF_LAYOUT) {/* 销毁此内存区（内存池）时，tlsf_signature赋值0*/
         mp = mem_pool;
+#if TLSF_PIC && !TLSF_SHM
+        TLSF_CREATE_LOCK(&tlsf->lock);  /* 锁句柄属于上一个进程/上一次运行，重新创建 */
+#endif
+#if TLSF_WATERMARK
+        memset(&tlsf->wm, 0, sizeof(tlsf->wm));  /* 回调地址同样属于上一次运行 */
+        tlsf->wm_state = 0;
+#endif
+#if TLSF_WAIT && TLSF_PIC
+        tlsf->waiters = NULL;               /* 等待者也是上一次运行的 */
+        tlsf_waitq_init(&tlsf->waitq);
+#endif
         b = GET_NEXT_BLOCK(mp, ROUNDUP_SIZE(sizeof(tlsf_t)));
         return b->size & BLOCK_SIZE;
     }
+    if (tlsf->tlsf_signature == TLSF_SIGNATURE)  /* 由不同布局的代码建立，只能重新初始化 */
+        ERROR_MSG("init_memory_pool (): layout mismatch, pool reinitialised\n");
 
     mp = mem_pool;
 		g_mp = mem_pool;
@@ -588,19 +1228,33 @@ size_t init_memory_pool(size_t mem_pool_size, void *mem_pool)
     memset(mem_pool, 0, sizeof(tlsf_t));  /* 内存池首sizeof(tlsf_t)字节清零，*/
 
     tlsf->tlsf_signature = TLSF_SIGNATURE;
+    tlsf->tlsf_layout = TLSF_LAYOUT;
+#if TLSF_PIC
+    tlsf->pool_size = mem_pool_size;
+#endif
 
     TLSF_CREATE_LOCK(&tlsf->lock);
+#if TLSF_WAIT
+    tlsf_waitq_init(&tlsf->waitq);
+#endif
     /*  对内存池中tlsf_t控制块之后的内存空间处理，返回bhdr_t类型指针ib*/
     ib = process_area(GET_NEXT_BLOCK
                       (mem_pool, ROUNDUP_SIZE(sizeof(tlsf_t))), ROUNDDOWN_SIZE(mem_pool_size - sizeof(tlsf_t)));
     b = GET_NEXT_BLOCK(ib->ptr.buffer, ib->size & BLOCK_SIZE);  /*  调整指针指向*/
     free_ex(b->ptr.buffer, tlsf); /*  删除b内存块，并根据情况合并内存块，更新相应信息*/
-    tlsf->area_head = (area_info_t *) ib->ptr.buffer;  /* tlsf初始化为ib->ptr.buffer*/
+    SET_AREA_HEAD(tlsf, (area_info_t *) ib->ptr.buffer);  /* tlsf初始化为ib->ptr.buffer*/
 
 #if TLSF_STATISTIC
     tlsf->used_size = mem_pool_size - (b->size & BLOCK_SIZE);
     tlsf->max_size = tlsf->used_size;
 #endif
+#if TLSF_WATERMARK
+    tlsf->free_size = b->size & BLOCK_SIZE;
+#endif
+#if TLSF_STATISTIC_EXT
+    tlsf->req_size = tlsf->grant_size = 0;
+    memset(tlsf->class_stat, 0, sizeof(tlsf->class_stat));  /* 不计入初始化时的free_ex */
+#endif
 
     return (b->size & BLOCK_SIZE);   /* 返回内存池中可用内存大小（总可分配动态内存大小）*/
 }
@@ -652,12 +1306,21 @@ size_t init_memory_pool(size_t mem_pool_size, void *mem_pool)
 size_t add_new_area(void *area, size_t area_size, void *mem_pool)
 {
 /******************************************************************/
+    return add_area(area, area_size, mem_pool, 0);
+}
+
+/*  加入内存区，sys为get_new_area()得到的内存区的长度（以后可以释放），其它为0*/
+static size_t add_area(void *area, size_t area_size, void *mem_pool, size_t sys)
+{
     tlsf_t *tlsf = (tlsf_t *) mem_pool;  /* 原内存池*/
     area_info_t *ptr, *ptr_prev, *ai;
     bhdr_t *ib0, *b0, *lb0, *ib1, *b1, *lb1, *next_b;
 
-    memset(area, 0, area_size);  /* 新增的内存清零*/
-    ptr = tlsf->area_head;       /* 得到tlsf->area_head，即第一内存块的块头*/
+    /* 不清零：process_area()写好用到的块头即可，大内存区不用在这里把每一页都碰一遍 */
+#if TLSF_HANDLE
+    SET_COMPACT_CURSOR(tlsf, NULL);  /* 内存区可能合并，整理从头开始 */
+#endif
+    ptr = AREA_HEAD(tlsf);       /* 得到tlsf->area_head，即第一内存块的块头*/
     ptr_prev = 0;
 
 	/* ib0 bo lb0 表示指向新内存区的指针*/
@@ -671,24 +1334,27 @@ size_t add_new_area(void *area, size_t area_size, void *mem_pool)
     while (ptr) {    /* ib1，b1,bl表示原内存池的一些指针*/
         ib1 = (bhdr_t *) ((char *) ptr - BHDR_OVERHEAD);
         b1 = GET_NEXT_BLOCK(ib1->ptr.buffer, ib1->size & BLOCK_SIZE);
-        lb1 = ptr->end;
+        lb1 = AREA_END(ptr);
 
         /* Merging the new area with the next physically contigous one 
 		如果新内存区与原内存池的物理地址相连接，并且新内存区在原内存池的前面prev*/
         if ((unsigned long) ib1 == (unsigned long) lb0 + BHDR_OVERHEAD) {
-            if (tlsf->area_head == ptr) { /*链表中的首个内存区（TLSF中的area_head指向此区）*/
-                tlsf->area_head = ptr->next;
-                ptr = ptr->next;
+#if AREA_TRIM
+            sys = (sys && ptr->sys) ? sys + ptr->sys : 0;
+#endif
+            if (AREA_HEAD(tlsf) == ptr) { /*链表中的首个内存区（TLSF中的area_head指向此区）*/
+                SET_AREA_HEAD(tlsf, AREA_NEXT(ptr));
+                ptr = AREA_NEXT(ptr);
             } else {
-                ptr_prev->next = ptr->next;
-                ptr = ptr->next;
+                SET_AREA_NEXT(ptr_prev, AREA_NEXT(ptr));
+                ptr = AREA_NEXT(ptr);
             }
 
             b0->size =
                 ROUNDDOWN_SIZE((b0->size & BLOCK_SIZE) +
                                (ib1->size & BLOCK_SIZE) + 2 * BHDR_OVERHEAD) | USED_BLOCK | PREV_USED;
 
-            b1->prev_hdr = b0;
+            SET_PREV_HDR(b1, b0);
             lb0 = lb1;
 
             continue;
@@ -697,37 +1363,149 @@ size_t add_new_area(void *area, size_t area_size, void *mem_pool)
         /* Merging the new area with the previous physically contigousone
 		如果新内存区与原内存池的物理地址相连接，并且新内存区在原内存池的后面* */
         if ((unsigned long) lb1->ptr.buffer == (unsigned long) ib0) {
-            if (tlsf->area_head == ptr) {
-                tlsf->area_head = ptr->next;
-                ptr = ptr->next;
+#if AREA_TRIM
+            sys = (sys && ptr->sys) ? sys + ptr->sys : 0;
+#endif
+            if (AREA_HEAD(tlsf) == ptr) {
+                SET_AREA_HEAD(tlsf, AREA_NEXT(ptr));
+                ptr = AREA_NEXT(ptr);
             } else {
-                ptr_prev->next = ptr->next;
-                ptr = ptr->next;
+                SET_AREA_NEXT(ptr_prev, AREA_NEXT(ptr));
+                ptr = AREA_NEXT(ptr);
             }
 
             lb1->size =
                 ROUNDDOWN_SIZE((b0->size & BLOCK_SIZE) +
                                (ib0->size & BLOCK_SIZE) + 2 * BHDR_OVERHEAD) | USED_BLOCK | (lb1->size & PREV_STATE);
             next_b = GET_NEXT_BLOCK(lb1->ptr.buffer, lb1->size & BLOCK_SIZE);
-            next_b->prev_hdr = lb1;
+            SET_PREV_HDR(next_b, lb1);
             b0 = lb1;
             ib0 = ib1;
 
             continue;
         }
         ptr_prev = ptr;
-        ptr = ptr->next;
+        ptr = AREA_NEXT(ptr);
     }
 
     /* Inserting the area in the list of linked areas */
     ai = (area_info_t *) ib0->ptr.buffer;
-    ai->next = tlsf->area_head;
-    ai->end = lb0;
-    tlsf->area_head = ai;
+    SET_AREA_NEXT(ai, AREA_HEAD(tlsf));
+    SET_AREA_END(ai, lb0);
+    SET_AREA_HEAD(tlsf, ai);
+#if AREA_TRIM
+    ai->sys = 0;        /* 整个内存区空闲，先不让free_ex()把它拿掉 */
+#else
+    (void) sys;
+#endif
     free_ex(b0->ptr.buffer, mem_pool);
+#if AREA_TRIM
+    ai->sys = sys;
+#endif
     return (b0->size & BLOCK_SIZE);  /*返回新增内存大小*/
 }
 
+/* prefault_pool_ex()中一个线程的工作：全部空闲块数据区按顺序排成一列时的[from, to)字节 */
+typedef struct prefault_job_struct {
+    tlsf_t *tlsf;
+    size_t from, to;
+} prefault_job_t;
+
+/*  让[p, end)所在的页都有物理内存：能用MADV_POPULATE_WRITE时一次完成，否则每页写一个字节*/
+static void prefault_range(char *p, char *end)
+{
+    size_t page = PREFAULT_PAGE;
+    char *a = (char *) ROUNDUP((size_t) p, page);  /* 首尾不满一页的部分与块头同页，已经碰过 */
+#ifdef MADV_POPULATE_WRITE
+    size_t len = ((size_t) end & ~(page - 1)) > (size_t) a ? ((size_t) end & ~(page - 1)) - (size_t) a : 0;
+
+    if (len && !madvise(a, len, MADV_POPULATE_WRITE))
+        a += len;
+#endif
+    for (; a < end; a += page)
+        *(volatile char *) a = 0;   /* 空闲块的数据区，内容无所谓 */
+}
+
+/*  遍历全部空闲块，跳过块头，触碰落在[from, to)中的部分；to为0时只统计字节数*/
+static void *prefault_job(void *arg)
+{
+    prefault_job_t *job = (prefault_job_t *) arg;
+    area_info_t *ai;
+    bhdr_t *b;
+    char *p, *end;
+    size_t pos = 0, lo, hi;
+
+    for (ai = AREA_HEAD(job->tlsf); ai; ai = AREA_NEXT(ai)) {
+        b = (bhdr_t *) ((char *) ai - BHDR_OVERHEAD);
+        for (; b->size & BLOCK_SIZE; b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE)) {
+            if (!(b->size & FREE_BLOCK))
+                continue;
+            p = (char *) b + sizeof(bhdr_t);
+            end = (char *) b->ptr.buffer + (b->size & BLOCK_SIZE);
+            lo = (job->from > pos) ? job->from : pos;
+            hi = (job->to < pos + (end - p)) ? job->to : pos + (end - p);
+            if (lo < hi)
+                prefault_range(p + (lo - pos), p + (hi - pos));
+            pos += end - p;
+        }
+    }
+    if (!job->to)
+        job->from = pos;
+    return NULL;
+}
+
+/* 函数功能：让内存池全部空闲块的页面现在就有物理内存（初始化与add_new_area()都不再清零，
+            页面在第一次使用时才分配），用于希望启动时就提交内存的场合。不上锁
+   形参：   mem_pool  内存池的首地址； nthreads  并行触碰的线程数（TLSF_PTHREAD/TLSF_SHM，
+            最多TLSF_PREFAULT_THREADS个，其它情况只用调用者自己）
+   返回：   处理的空闲字节数
+*/
+/******************************************************************/
+size_t prefault_pool_ex(void *mem_pool, int nthreads)
+{
+/******************************************************************/
+    prefault_job_t job[TLSF_PREFAULT_THREADS];
+    size_t total;
+    int i;
+#if TLSF_PTHREAD || TLSF_SHM
+    pthread_t th[TLSF_PREFAULT_THREADS];
+    int started[TLSF_PREFAULT_THREADS];
+#endif
+
+    job[0].tlsf = (tlsf_t *) mem_pool;
+    job[0].from = job[0].to = 0;
+    prefault_job(&job[0]);      /* 先统计总字节数 */
+    total = job[0].from;
+    if (!total)
+        return 0;
+#if TLSF_PTHREAD || TLSF_SHM
+    if (nthreads > TLSF_PREFAULT_THREADS)
+        nthreads = TLSF_PREFAULT_THREADS;
+#endif
+    if (nthreads < 1 || !(TLSF_PTHREAD || TLSF_SHM))
+        nthreads = 1;
+
+    for (i = 0; i < nthreads; i++) {
+        job[i].tlsf = (tlsf_t *) mem_pool;
+        job[i].from = total / nthreads * i;
+        job[i].to = (i == nthreads - 1) ? total : total / nthreads * (i + 1);
+    }
+#if TLSF_PTHREAD || TLSF_SHM
+    for (i = 1; i < nthreads; i++)
+        started[i] = !pthread_create(&th[i], NULL, prefault_job, &job[i]);
+    prefault_job(&job[0]);
+    for (i = 1; i < nthreads; i++) {
+        if (started[i])
+            pthread_join(th[i], NULL);
+        else
+            prefault_job(&job[i]);  /* 线程建不起来就自己做 */
+    }
+#else
+    prefault_job(&job[0]);
+#endif
+    return total;
+}
+
 
 /* 下面两个函数用于查询，动态内存的使用情况*/
 /******************************************************************/
@@ -752,19 +1530,621 @@ size_t get_max_size(void *mem_pool)
 #endif
 }
 
-/* 内存池销毁函数*/
+/* 函数功能：读取统计信息的快照
+   形参：   mem_pool  内存池的首地址； stat  快照存放地址（未开启的统计项为0）
+*/
 /******************************************************************/
-void destroy_memory_pool(void *mem_pool)
+void get_stat_info(void *mem_pool, tlsf_stat_t *stat)
 {
 /******************************************************************/
-    tlsf_t *tlsf = (tlsf_t *) mem_pool;
-
-    tlsf->tlsf_signature = 0; /* 用来表示内存区销毁*/
+    memset(stat, 0, sizeof(*stat));
+#if TLSF_STATISTIC
+    stat->used_size = ((tlsf_t *) mem_pool)->used_size;
+    stat->max_size = ((tlsf_t *) mem_pool)->max_size;
+#endif
+#if TLSF_STATISTIC_EXT
+    stat->req_size = ((tlsf_t *) mem_pool)->req_size;
+    stat->grant_size = ((tlsf_t *) mem_pool)->grant_size;
+    memcpy(stat->cls, ((tlsf_t *) mem_pool)->class_stat, sizeof(stat->cls));
+#endif
+#if USE_MMAP || USE_SBRK
+    stat->sys_calls = ((tlsf_t *) mem_pool)->sys_calls;
+    stat->sys_saved = ((tlsf_t *) mem_pool)->sys_saved;
+#endif
+}
+
+/* 堆快照的输出缓冲，攒满后交给用户的写回调 */
+typedef struct snap_out_struct {
+    tlsf_snap_write_t write;
+    void *arg;
+    size_t total;           /* 已写出的字节数 */
+    int err;                /* 写回调失败后不再输出 */
+    int len;
+    u8_t buf[64];
+} snap_out_t;
+
+static void snap_flush(snap_out_t *o)
+{
+    if (o->len && !o->err) {
+        if (o->write(o->buf, o->len, o->arg))
+            o->err = 1;
+        else
+            o->total += o->len;
+    }
+    o->len = 0;
+}
+
+/* 写一个LEB128变长整数，最长10字节 */
+static void snap_put(snap_out_t *o, u64_t v)
+{
+    if (o->len > (int) sizeof(o->buf) - 10)
+        snap_flush(o);
+    do {
+        o->buf[o->len] = (u8_t) (v & 0x7f);
+        v >>= 7;
+        if (v)
+            o->buf[o->len] |= 0x80;
+        o->len++;
+    } while (v);
+}
+
+/* 函数功能：把内存池的全部区域、块和位图以紧凑的二进制格式（见 tlsf.h）流式写出，
+            用于离线分析碎片（tlsf_snap.c），不上锁
+   形参：   mem_pool  内存池的首地址； write  写回调，每次最多64字节；
+            tag  可为NULL，返回已分配块的属主标签； arg  传给两个回调
+   返回：   写出的字节数，写回调失败时返回0
+*/
+/******************************************************************/
+size_t write_snapshot_ex(void *mem_pool, tlsf_snap_write_t write, tlsf_snap_tag_t tag, void *arg)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    snap_out_t o;
+    area_info_t *ai;
+    bhdr_t *b;
+    long long off;
+    unsigned long owner;
+    u64_t v;
+    int i;
+
+    o.write = write;
+    o.arg = arg;
+    o.total = 0;
+    o.err = 0;
+    memset(o.buf, 0, TLSF_SNAP_HDR_SIZE);
+    memcpy(o.buf, "TLSN", 4);
+    o.buf[4] = TLSF_SNAP_VERSION;
+    o.buf[5] = (u8_t) sizeof(void *);
+    o.buf[6] = (u8_t) BHDR_OVERHEAD;
+    o.buf[7] = (u8_t) BLOCK_ALIGN;
+    o.buf[8] = (u8_t) REAL_FLI;
+    o.buf[9] = (u8_t) MAX_LOG2_SLI;
+    o.buf[10] = (u8_t) FLI_OFFSET;
+    o.buf[11] = (u8_t) ms_bit(SMALL_BLOCK);
+    o.buf[12] = tag ? TLSF_SNAP_TAGS : 0;
+    o.len = TLSF_SNAP_HDR_SIZE;
+
+    snap_put(&o, TLSF_SNAP_BITMAP);
+    snap_put(&o, tlsf->fl_bitmap);
+    for (i = 0; i < REAL_FLI; i++)
+        snap_put(&o, tlsf->sl_bitmap[i]);
+
+    snap_put(&o, TLSF_SNAP_STAT);
+    snap_put(&o, get_used_size(mem_pool));
+    snap_put(&o, get_max_size(mem_pool));
+
+    for (ai = AREA_HEAD(tlsf); ai; ai = AREA_NEXT(ai)) {
+        b = (bhdr_t *) ((char *) ai - BHDR_OVERHEAD);
+        off = (long long) ((char *) b - (char *) mem_pool);
+        snap_put(&o, TLSF_SNAP_AREA);
+        snap_put(&o, ((u64_t) off << 1) ^ (u64_t) (off >> 63));
+        for (;;) {
+            v = b->size & (BLOCK_SIZE | BLOCK_STATE | PREV_STATE);
+            owner = 0;
+            /* 区域的第一个块存放area_info_t，不属于任何用户 */
+            if (tag && (b->size & BLOCK_SIZE) && !(b->size & FREE_BLOCK) && b->ptr.buffer != (u8_t *) ai)
+                owner = tag(b->ptr.buffer, arg);
+            if (owner)
+                v |= TLSF_SNAP_TAG;
+            snap_put(&o, v);
+            if (owner)
+                snap_put(&o, owner);
+            if (!(b->size & BLOCK_SIZE))
+                break;
+            b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
+        }
+    }
+    snap_put(&o, TLSF_SNAP_END);
+    snap_flush(&o);
+    return o.err ? 0 : o.total;
+}
+
+#if TLSF_LOCK_STAT
+/* 函数功能：读取锁统计（不上锁，各项可能不是同一时刻的值）
+   形参：   mem_pool  内存池的首地址； stat  存放地址； reset  非0时读取后清零
+*/
+/******************************************************************/
+void get_lock_stat_ex(void *mem_pool, tlsf_lock_stat_t *stat, int reset)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+
+    *stat = tlsf->lock_stat;
+    if (reset)
+        memset(&tlsf->lock_stat, 0, sizeof(tlsf->lock_stat));
+}
+
+/******************************************************************/
+void tlsf_get_lock_stat(tlsf_lock_stat_t *stat, int reset)
+{
+/******************************************************************/
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+    get_lock_stat_ex(mp, stat, reset);
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+}
+#endif
+
+#if TLSF_PIC
+/* 函数功能：设置/读取内存池的根对象。内存池被重新映射（可能在另一个地址）后，
+             应用程序由根对象找回保存在池中的数据
+*/
+/******************************************************************/
+void set_pool_root(void *mem_pool, void *root)
+{
+/******************************************************************/
+    LINK_SET(((tlsf_t *) mem_pool)->root, root);
+}
+
+/******************************************************************/
+void *get_pool_root(void *mem_pool)
+{
+/******************************************************************/
+    return LINK_GET(void, ((tlsf_t *) mem_pool)->root);
+}
+
+/* 函数功能：内存池中的指针与偏移互相转换。共享内存池在各进程中的映射地址不同，
+             进程间只能传递偏移
+*/
+/******************************************************************/
+size_t pool_ptr_to_offset(void *mem_pool, void *ptr)
+{
+/******************************************************************/
+    return ptr ? (size_t) ((char *) ptr - (char *) mem_pool) : 0;
+}
+
+/******************************************************************/
+void *pool_offset_to_ptr(void *mem_pool, size_t offset)
+{
+/******************************************************************/
+    return offset ? (void *) ((char *) mem_pool + offset) : NULL;
+}
+#endif
+
+#if TLSF_SHM
+/*  持锁进程中途退出后检查内存池：物理块链、前后块状态、空闲链表与位图是否一致。
+    只读内存池，每一步都检查地址范围并限制总步数，链接损坏（包括成环）也能返回。完好时返回1 */
+static int heap_check(tlsf_t *tlsf)
+{
+    char *lo = (char *) tlsf, *hi = (char *) tlsf + tlsf->pool_size;
+    size_t steps = tlsf->pool_size / sizeof(bhdr_t), nfree = 0;
+    bitmap_t fl_seen = 0, sl_seen[REAL_FLI];
+    area_info_t *ai;
+    bhdr_t *b, *next_b, *f, *prev;
+    int fl, sl, prev_free;
+
+#define	HEAP_IN(_p, _n)	((char *) (_p) >= lo && (char *) (_p) <= hi - (_n) && steps--)
+
+    memset(sl_seen, 0, sizeof(sl_seen));
+    for (ai = AREA_HEAD(tlsf); ai; ai = AREA_NEXT(ai)) {
+        b = (bhdr_t *) ((char *) ai - BHDR_OVERHEAD);
+        if (!HEAP_IN(b, sizeof(bhdr_t)))
+            return 0;
+        prev_free = 0;
+        while (b->size & BLOCK_SIZE) {
+            if ((b->size & BLOCK_SIZE) > (size_t) (hi - (char *) b->ptr.buffer) - BHDR_OVERHEAD)
+                return 0;
+            next_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
+            if (!HEAP_IN(next_b, BHDR_OVERHEAD) || !!(next_b->size & PREV_FREE) != !!(b->size & FREE_BLOCK))
+                return 0;
+            if (b->size & FREE_BLOCK) {
+                MAPPING_INSERT(b->size & BLOCK_SIZE, &fl, &sl);
+                if ((prev_free && !tlsf->warm_cnt) || fl >= REAL_FLI || PREV_HDR(next_b) != b)
+                    return 0;
+                fl_seen |= (bitmap_t) 1 << fl;
+                sl_seen[fl] |= (bitmap_t) 1 << sl;
+                nfree++;
+            }
+            prev_free = b->size & FREE_BLOCK;
+            b = next_b;
+        }
+        if (b != AREA_END(ai))
+            return 0;
+    }
+    if (fl_seen != tlsf->fl_bitmap)
+        return 0;
+    for (fl = 0; fl < REAL_FLI; fl++) {
+        if (sl_seen[fl] != tlsf->sl_bitmap[fl])
+            return 0;
+        for (sl = 0; sl < MAX_SLI; sl++) {
+            for (prev = NULL, f = MATRIX(tlsf, fl, sl); f; prev = f, f = FREE_NEXT(f)) {
+                int _fl, _sl;
+
+                if (!HEAP_IN(f, sizeof(bhdr_t)) || !(f->size & FREE_BLOCK) || FREE_PREV(f) != prev)
+                    return 0;
+                MAPPING_INSERT(f->size & BLOCK_SIZE, &_fl, &_sl);
+                if (_fl != fl || _sl != sl || !nfree--)
+                    return 0;
+            }
+        }
+    }
+#undef	HEAP_IN
+    return nfree == 0;          /* 每个空闲块都恰好在一个链表中 */
+}
+
+#if TLSF_USE_LOCKS
+/*  加锁得到EOWNERDEAD时调用（见target.h）：上一个持有者可能死在INSERT_BLOCK/EXTRACT_BLOCK
+    中间，内存池不一致时标记为TLSF_POISON，之后的分配都失败，不再使用可能损坏的堆 */
+static void tlsf_lock_recover(pthread_mutex_t *l)
+{
+    tlsf_t *tlsf = (tlsf_t *) ((char *) l - offsetof(tlsf_t, lock));
+
+    if (tlsf->tlsf_signature == TLSF_SIGNATURE && !heap_check(tlsf)) {
+        ERROR_MSG("tlsf: lock owner died inside the allocator, pool poisoned\n");
+        tlsf->tlsf_signature = TLSF_POISON;
+    }
+    pthread_mutex_consistent(l);
+}
+#endif
+
+/* 函数功能：建立或挂接POSIX共享内存中的内存池
+   形参：   name  共享内存名（shm_open 的名字，如 "/msg_pool"）；
+            size  非0时新建该大小的共享内存并初始化内存池（名字已存在则失败），
+                  为0时挂接已由其它进程建好的内存池
+   返回：   本进程中的内存池首地址，失败返回NULL
+   说明：   各进程映射地址不同，进程间用 pool_ptr_to_offset()/pool_offset_to_ptr() 传递内存块；
+            多进程同时使用时以 lock_memory_pool()/unlock_memory_pool() 包围 malloc_ex/free_ex。
+            新建者返回之前其它进程不要挂接。不再使用时由调用者 shm_unlink(name)
+*/
+/******************************************************************/
+void *open_shared_pool(const char *name, size_t size)
+{
+/******************************************************************/
+    struct stat st;
+    tlsf_t *tlsf;
+    void *area;
+    int fd;
+
+    if (size) {
+        if ((fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600)) < 0)
+            return NULL;
+        if (ftruncate(fd, (off_t) size) < 0) {
+            close(fd);
+            shm_unlink(name);
+            return NULL;
+        }
+    } else {
+        if ((fd = shm_open(name, O_RDWR, 0)) < 0)
+            return NULL;
+        if (fstat(fd, &st) < 0) {
+            close(fd);
+            return NULL;
+        }
+        size = (size_t) st.st_size;
+    }
+
+    area = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (area == MAP_FAILED)
+        return NULL;
+
+    tlsf = (tlsf_t *) area;
+    if (tlsf->tlsf_signature == TLSF_POISON) {      /* 其它进程还在用，也不能重新初始化 */
+        ERROR_MSG("open_shared_pool (): %s was poisoned by a dead lock owner\n", name);
+        munmap(area, size);
+        return NULL;
+    }
+    if (tlsf->tlsf_signature == TLSF_SIGNATURE) {   /* 挂接：不能再调用init_memory_pool，锁正被其它进程使用 */
+        if (tlsf->tlsf_layout != TLSF_LAYOUT || tlsf->pool_size != size) {
+            ERROR_MSG("open_shared_pool (): %s is not a pool of this layout\n", name);
+            munmap(area, size);
+            return NULL;
+        }
+        return area;
+    }
+    if (init_memory_pool(size, area) == (size_t) -1) {
+        munmap(area, size);
+        return NULL;
+    }
+    return area;
+}
+
+/* 函数功能：解除本进程对共享内存池的映射，池本身及其它进程不受影响
+*/
+/******************************************************************/
+void close_shared_pool(void *mem_pool)
+{
+/******************************************************************/
+    munmap(mem_pool, ((tlsf_t *) mem_pool)->pool_size);
+    if (mp == mem_pool)
+        mp = NULL;
+}
+#endif
+
+#if TLSF_PERSIST
+/* 函数功能：打开以文件为后端的持久化内存池
+   形参：   path  内存池文件；size  文件不存在（或为空）时新建的大小，已有文件时忽略
+   返回：   映射后的内存池首地址；文件由不同布局的代码建立或映射失败时返回NULL
+   说明：   文件以MAP_SHARED映射，内存池内部使用相对链接，下次打开时映射地址可以不同
+*/
+/******************************************************************/
+void *open_persistent_pool(const char *path, size_t size)
+{
+/******************************************************************/
+    struct stat st;
+    tlsf_t *tlsf;
+    void *area;
+    int fd, fresh;
+
+    if ((fd = open(path, O_RDWR | O_CREAT, 0600)) < 0)
+        return NULL;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return NULL;
+    }
+    fresh = (st.st_size == 0);
+    if (fresh) {
+        if (ftruncate(fd, (off_t) size) < 0) {
+            close(fd);
+            return NULL;
+        }
+    } else
+        size = (size_t) st.st_size;
+
+    area = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (area == MAP_FAILED)
+        return NULL;
+
+    tlsf = (tlsf_t *) area;
+    if (!fresh && (tlsf->tlsf_signature != TLSF_SIGNATURE || tlsf->tlsf_layout != TLSF_LAYOUT
+                   || tlsf->pool_size != size)) {
+        ERROR_MSG("open_persistent_pool (): %s is not a pool of this layout\n", path);
+        munmap(area, size);
+        return NULL;
+    }
+    if (init_memory_pool(size, area) == (size_t) -1) {
+        munmap(area, size);
+        return NULL;
+    }
+    return area;
+}
+
+/* 函数功能：把持久化内存池写回文件并解除映射，内存池中的数据保留在文件中
+*/
+/******************************************************************/
+void close_persistent_pool(void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    size_t size = tlsf->pool_size;
+
+    TLSF_DESTROY_LOCK(&tlsf->lock);
+#if TLSF_WAIT
+    tlsf_waitq_destroy(&tlsf->waitq);
+#endif
+    msync(mem_pool, size, MS_SYNC);
+    munmap(mem_pool, size);
+    if (mp == mem_pool)
+        mp = NULL;
+}
+#endif
+
+/* 内存池销毁函数*/
+/******************************************************************/
+void destroy_memory_pool(void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+
+    tlsf->tlsf_signature = 0; /* 用来表示内存区销毁*/
 
     TLSF_DESTROY_LOCK(&tlsf->lock);  /* 操作系统函数相关，或自定义函数*/
+#if AREA_TRIM && TLSF_AREA_CACHE
+    while (tlsf->area_cached > 0) {
+        tlsf->area_cached--;
+        munmap(tlsf->area_cache[tlsf->area_cached].area, tlsf->area_cache[tlsf->area_cached].size);
+    }
+#endif
+#if TLSF_WAIT
+    tlsf_waitq_destroy(&tlsf->waitq);
+#endif
+
+}
+
+
+#if TLSF_PROFILE
+/***************  采样式内存剖析 **************/
+
+/* 采样以字节为单位服从泊松过程：两次采样之间的字节数服从均值为prof_interval的指数分布，
+   大块更容易被采到，且与分配的先后规律无关。所有函数都在内存池锁内调用。*/
+
+static tlsf_sample_t prof_slot[TLSF_PROFILE_SLOTS];
+static size_t prof_interval = 0;    /* 0 表示未开启 */
+static size_t prof_dropped = 0;     /* 槽位满而丢弃的样本数 */
+static u32_t prof_seed = 0x2545F491;
+
+#define PROFILE_HASH(_p)    ((((unsigned long) (_p)) / BLOCK_ALIGN) & (TLSF_PROFILE_SLOTS - 1))
+
+/*  下一个采样间隔 = -ln(U) * prof_interval，U为(0,1]上的均匀分布。
+    用定点数计算，不依赖浮点库：-ln(x/2^32) = ln2 * (32 - log2(x))，log2的小数部分线性近似 */
+static size_t profile_next_interval(void)
+{
+    u32_t x = prof_seed;
+    u32_t frac, nlog2;
+    int e;
+
+    x ^= x << 13;       /* xorshift32 */
+    x ^= x >> 17;
+    x ^= x << 5;
+    prof_seed = x;
+
+    x |= 1;
+    e = ms_bit(x);
+    frac = (e >= 16) ? (x >> (e - 16)) & 0xFFFF : (x << (16 - e)) & 0xFFFF;
+    nlog2 = ((u32_t) (32 - e) << 16) - frac;                 /* 32 - log2(x)，Q16 */
+    /* 线性近似下nlog2的均值为1.5而不是1/ln2，乘以 2^16/1.5 = 43691（= ln2的Q16值45426 × 0.9618）
+       使间隔的均值正好为prof_interval */
+    return (size_t) ((((u64_t) nlog2 * 43691 >> 16) * prof_interval >> 16) + 1);
+}
+
+static void profile_sample(void *ptr, size_t size, void *caller)
+{
+    tlsf_sample_t *smp;
+    size_t i, n;
+
+    if (!prof_interval) {       /* 未开启：只是计数器用完了 */
+        prof_left = LONG_MAX;
+        return;
+    }
+    prof_left = (long) profile_next_interval();
+
+    for (i = PROFILE_HASH(ptr), n = 0; n < TLSF_PROFILE_SLOTS; i = (i + 1) & (TLSF_PROFILE_SLOTS - 1), n++)
+        if (!prof_slot[i].ptr)
+            break;
+    if (n == TLSF_PROFILE_SLOTS) {
+        prof_dropped++;
+        return;
+    }
+
+    smp = &prof_slot[i];
+    smp->ptr = ptr;
+    smp->size = size;
+#if defined(__linux__)
+    (void) caller;
+    smp->depth = backtrace(smp->callers, TLSF_PROFILE_DEPTH);
+#else
+    smp->callers[0] = caller;   /* Cortex-M上只记录调用者的返回地址 */
+    smp->depth = 1;
+#endif
+    prof_live++;
+}
+
+static tlsf_sample_t *profile_find(void *ptr)
+{
+    size_t i, n;
+
+    for (i = PROFILE_HASH(ptr), n = 0; n < TLSF_PROFILE_SLOTS && prof_slot[i].ptr;
+         i = (i + 1) & (TLSF_PROFILE_SLOTS - 1), n++)
+        if (prof_slot[i].ptr == ptr)
+            return &prof_slot[i];
+    return NULL;
+}
+
+/*  删除样本，线性探测表中删除后要把后面的项前移，保证查找不被打断 */
+static void profile_forget(void *ptr)
+{
+    tlsf_sample_t *smp = profile_find(ptr);
+    size_t i, j, h;
+
+    if (!smp)
+        return;
+    i = (size_t) (smp - prof_slot);
+    prof_slot[i].ptr = NULL;
+    prof_live--;
+
+    for (j = (i + 1) & (TLSF_PROFILE_SLOTS - 1); prof_slot[j].ptr; j = (j + 1) & (TLSF_PROFILE_SLOTS - 1)) {
+        h = PROFILE_HASH(prof_slot[j].ptr);
+        /* h 不在 (i, j] 循环区间内时，j 项可以移到 i */
+        if ((i <= j) ? (h <= i || h > j) : (h <= i && h > j)) {
+            prof_slot[i] = prof_slot[j];
+            prof_slot[j].ptr = NULL;
+            i = j;
+        }
+    }
+}
+
+static void profile_move(void *old_ptr, void *ptr, size_t size)
+{
+    tlsf_sample_t *smp = profile_find(old_ptr);
+    tlsf_sample_t tmp;
+
+    if (!smp)
+        return;
+    if (!ptr) {                 /* realloc(ptr, 0) 等同 free */
+        profile_forget(old_ptr);
+        return;
+    }
+    tmp = *smp;
+    profile_forget(old_ptr);
+    prof_live++;
+    tmp.ptr = ptr;
+    tmp.size = size;
+    smp = &prof_slot[PROFILE_HASH(ptr)];
+    while (smp->ptr)            /* 刚删除了一项，必有空位 */
+        smp = (smp == &prof_slot[TLSF_PROFILE_SLOTS - 1]) ? prof_slot : smp + 1;
+    *smp = tmp;
+}
+#endif
+
+/* 函数功能：开启/关闭默认内存池的采样剖析
+   形参：   interval  平均采样间隔（字节），0 表示关闭；已有样本保留到对应内存块释放
+*/
+/******************************************************************/
+void tlsf_profile_start(size_t interval)
+{
+/******************************************************************/
+#if TLSF_PROFILE
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
 
+    prof_interval = interval;
+    prof_left = interval ? (long) profile_next_interval() : LONG_MAX;
+
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+#else
+    (void) interval;
+#endif
 }
 
+/* 函数功能：输出当前未释放的全部样本
+   形参：   cb  每个样本调用一次，为NULL时用PRINT_MSG输出； arg  传给cb的参数
+   返回：   未释放的样本数（不含因槽位满而丢弃的）
+*/
+/******************************************************************/
+size_t tlsf_profile_dump(void (*cb)(const tlsf_sample_t *, void *), void *arg)
+{
+/******************************************************************/
+#if TLSF_PROFILE
+    size_t i, live;
+    int d;
+
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+
+    live = prof_live;
+    if (!cb)
+        PRINT_MSG("\nTLSF profile: %lu live samples, interval %lu, dropped %lu\n",
+                  (unsigned long) prof_live, (unsigned long) prof_interval, (unsigned long) prof_dropped);
+    for (i = 0; i < TLSF_PROFILE_SLOTS; i++) {
+        if (!prof_slot[i].ptr)
+            continue;
+        if (cb) {
+            cb(&prof_slot[i], arg);
+            continue;
+        }
+        PRINT_MSG(">> [%p] %lu bytes:", prof_slot[i].ptr, (unsigned long) prof_slot[i].size);
+        for (d = 0; d < prof_slot[i].depth; d++)
+            PRINT_MSG(" %p", prof_slot[i].callers[d]);
+        PRINT_MSG("\n");
+    }
+
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+
+    return live;
+#else
+    (void) cb;
+    (void) arg;
+    return 0;
+#endif
+}
 
 /* 函数功能：tlsf内存分配函数
    形参：   size  所需内存的大小
@@ -793,6 +2173,7 @@ void *tlsf_malloc(size_t size)
     TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock); /*获取上锁，与操作系统有关*/
 
     ret = malloc_ex(size, mp);
+    TLSF_PROFILE_ALLOC(ret, size);
 
     TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock); /*获取解锁，与操作系统有关*/
 		
@@ -811,8 +2192,11 @@ void tlsf_free(void *ptr)
 {
 /******************************************************************/
 
+    if (!ptr)   /* 与free(NULL)一样什么也不做，默认内存池可能还不存在或已销毁 */
+        return;
     TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);  /*上锁，与操作系统有关*/
 
+    TLSF_PROFILE_FREE(ptr);
     free_ex(ptr, mp);
 
     TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock); /*解锁，与操作系统有关*/
@@ -838,9 +2222,47 @@ void *tlsf_realloc(void *ptr, size_t size)
     TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
 
     ret = realloc_ex(ptr, size, mp);
+    if (ptr && (ret || !size))      /* 原块已释放或移动，更新样本 */
+        TLSF_PROFILE_MOVE(ptr, ret, size);
+
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+
+    return ret;
+}
+
+/* 函数功能：原地扩大ptr所指的内存块，不移动，见try_expand_ex()
+   形参：   ptr  原内存的首地址指针； min  至少需要的大小； max  希望的大小
+   返回：   扩大后实际可用的字节数；原地达不到min时返回0，内存块不变
+*/
+/******************************************************************/
+size_t tlsf_try_expand(void *ptr, size_t min, size_t max)
+{
+/******************************************************************/
+    size_t ret;
 
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+    ret = try_expand_ex(ptr, min, max, mp);
+    if (ret)
+        TLSF_PROFILE_MOVE(ptr, ptr, ret);
     TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+    return ret;
+}
+
+/* 函数功能：原地缩小ptr所指的内存块，不移动，见shrink_in_place_ex()
+   形参：   ptr  原内存的首地址指针； size  缩小后所需的大小
+   返回：   缩小后实际可用的字节数
+*/
+/******************************************************************/
+size_t tlsf_shrink_in_place(void *ptr, size_t size)
+{
+/******************************************************************/
+    size_t ret;
 
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+    ret = shrink_in_place_ex(ptr, size, mp);
+    if (ptr)
+        TLSF_PROFILE_MOVE(ptr, ptr, ret);
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
     return ret;
 }
 
@@ -860,56 +2282,447 @@ void *tlsf_calloc(size_t nelem, size_t elem_size)
     TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
 
     ret = calloc_ex(nelem, elem_size, mp);
+    TLSF_PROFILE_ALLOC(ret, nelem * elem_size);
 
     TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);  
 
     return ret;
 }
 
-/* 函数功能：ex内存分配函数，实际内存分配函数
-   形参：   size  所需内存的大小； men_pool  内存池的首地址
-   返回：   viod *  （无符号指针）。分配成功后，返回内存块的指针ret；分配失败返回NULL。
-*/
 /******************************************************************/
-void *malloc_ex(size_t size, void *mem_pool)
+void *tlsf_malloc_size(size_t size, size_t *granted)
 {
 /******************************************************************/
-    tlsf_t *tlsf = (tlsf_t *) mem_pool;
-    bhdr_t *b, *b2, *next_b;
-    int fl, sl;
-    size_t tmp_size;
+    void *ret;
 
-	/*  调整size值，最小为MIN_BLOCK_SIZE，最小（sizeof(free_ptr_t)）*/
-    size = (size < MIN_BLOCK_SIZE) ? MIN_BLOCK_SIZE : ROUNDUP_SIZE(size);
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
 
-    /* Rounding up the requested size and calculating fl and sl */
+    ret = malloc_size_ex(size, granted, mp);
+    TLSF_PROFILE_ALLOC(ret, size);
+
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+
+    if (ret == NULL)
+        mem_errorno = 0x01;
+
+    return ret;
+}
+
+#if TLSF_WAIT
+/* 函数功能：从默认内存池分配，内存不足时最多等待timeout，见malloc_wait_ex
+*/
+/******************************************************************/
+void *tlsf_malloc_wait(size_t size, unsigned long timeout)
+{
+/******************************************************************/
+    void *ret = malloc_wait_ex(size, timeout, TLSF_WAIT_SELF_PRIO(), mp);
+
+    if (ret == NULL)
+        mem_errorno = 0x01;
+    else {
+        TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+        TLSF_PROFILE_ALLOC(ret, size);
+        TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+    }
+    return ret;
+}
+#endif
+
+/* 函数功能：按生存期从默认内存池分配，见malloc_hint_ex
+*/
+/******************************************************************/
+void *tlsf_malloc_hint(size_t size, int hint)
+{
+/******************************************************************/
+    void *ret;
+
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+
+    ret = malloc_hint_ex(size, hint, mp);
+    TLSF_PROFILE_ALLOC(ret, size);
+
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+
+    if (ret == NULL)
+        mem_errorno = 0x01;
+
+    return ret;
+}
+
+/* 函数功能：按已算好的大小类从默认内存池分配，见malloc_class_ex
+*/
+/******************************************************************/
+void *tlsf_malloc_class(size_t size, int fl, int sl)
+{
+/******************************************************************/
+    void *ret;
+
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+
+    ret = malloc_class_ex(size, fl, sl, mp);
+    TLSF_PROFILE_ALLOC(ret, size);
+
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+
+    if (ret == NULL)
+        mem_errorno = 0x01;
+
+    return ret;
+}
+
+/* 函数功能：按align对齐分配内存
+   形参：   align  对齐值（2的幂）；size  所需内存的大小
+   返回：   分配成功返回对齐的内存块指针，失败返回NULL
+*/
+/******************************************************************/
+void *tlsf_memalign(size_t align, size_t size)
+{
+/******************************************************************/
+    void *ret;
+
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+
+    ret = memalign_ex(align, size, mp);
+    TLSF_PROFILE_ALLOC(ret, size);
+
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+
+    if (ret == NULL)
+        mem_errorno = 0x01;
+
+    return ret;
+}
+
+/* 对任意内存池上锁/解锁，供直接调用*_ex函数的上层（如C++适配层）使用。
+   上锁返回0表示共享内存池已因持锁进程中途退出而失效（TLSF_SHM），其上的操作都会失败，
+   仍需解锁 */
+/******************************************************************/
+int lock_memory_pool(void *mem_pool)
+{
+/******************************************************************/
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mem_pool)->lock);
+    return !POOL_POISONED((tlsf_t *) mem_pool);
+}
+
+/******************************************************************/
+void unlock_memory_pool(void *mem_pool)
+{
+/******************************************************************/
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mem_pool)->lock);
+}
+
+/******************************************************************/
+void tlsf_get_stat(tlsf_stat_t *stat)
+{
+/******************************************************************/
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+
+    get_stat_info(mp, stat);
+
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+}
+
+/******************************************************************/
+size_t tlsf_warm(const tlsf_warm_t *prof, int n)
+{
+/******************************************************************/
+    size_t ret;
+
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+    ret = warm_pool_ex(mp, prof, n);
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+    return ret;
+}
+
+/******************************************************************/
+size_t tlsf_prefault(int nthreads)
+{
+/******************************************************************/
+    size_t ret;
+
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+    ret = prefault_pool_ex(mp, nthreads);
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+    return ret;
+}
+
+/******************************************************************/
+size_t tlsf_write_snapshot(tlsf_snap_write_t write, tlsf_snap_tag_t tag, void *arg)
+{
+/******************************************************************/
+    size_t ret;
+
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+    ret = write_snapshot_ex(mp, write, tag, arg);
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+    return ret;
+}
+
+/*  大块复制/清零：超过TLSF_NT_THRESHOLD且有SSE2时用非临时存储，否则就是memcpy/memset*/
+#if defined(__SSE2__)
+static void bulk_copy(void *dst, const void *src, size_t n)
+{
+    char *d = (char *) dst;
+    const char *s = (const char *) src;
+    size_t head;
+
+    if (n < TLSF_NT_THRESHOLD) {
+        memcpy(dst, src, n);
+        return;
+    }
+    head = (16 - ((size_t) d & 15)) & 15;   /* 目的地址对齐到16字节 */
+    memcpy(d, s, head);
+    d += head;
+    s += head;
+    n -= head;
+    for (; n >= 64; n -= 64, d += 64, s += 64) {
+        __m128i x0 = _mm_loadu_si128((const __m128i *) s);
+        __m128i x1 = _mm_loadu_si128((const __m128i *) (s + 16));
+        __m128i x2 = _mm_loadu_si128((const __m128i *) (s + 32));
+        __m128i x3 = _mm_loadu_si128((const __m128i *) (s + 48));
+        _mm_stream_si128((__m128i *) d, x0);
+        _mm_stream_si128((__m128i *) (d + 16), x1);
+        _mm_stream_si128((__m128i *) (d + 32), x2);
+        _mm_stream_si128((__m128i *) (d + 48), x3);
+    }
+    _mm_sfence();
+    memcpy(d, s, n);
+}
+
+static void bulk_zero(void *dst, size_t n)
+{
+    char *d = (char *) dst;
+    size_t head;
+    __m128i z = _mm_setzero_si128();
+
+    if (n < TLSF_NT_THRESHOLD) {
+        memset(dst, 0, n);
+        return;
+    }
+    head = (16 - ((size_t) d & 15)) & 15;
+    memset(d, 0, head);
+    d += head;
+    n -= head;
+    for (; n >= 64; n -= 64, d += 64) {
+        _mm_stream_si128((__m128i *) d, z);
+        _mm_stream_si128((__m128i *) (d + 16), z);
+        _mm_stream_si128((__m128i *) (d + 32), z);
+        _mm_stream_si128((__m128i *) (d + 48), z);
+    }
+    _mm_sfence();
+    memset(d, 0, n);
+}
+#else
+#define bulk_copy(_d, _s, _n)   memcpy(_d, _s, _n)
+#define bulk_zero(_d, _n)       memset(_d, 0, _n)
+#endif
+
+#if TLSF_MMAP_THRESHOLD
+/*  单独映射的块：块头放在映射起点之后 align - BHDR_OVERHEAD 处，用户数据按align对齐
+    （align不超过一页），映射起点由块头地址向下取整到页得到*/
+#define MAPPED_BASE(_b)     ((char *) ((unsigned long) (_b) & ~((unsigned long) PAGE_SIZE - 1)))
+
+#define MAPPED_CAP(_b)      (((_b)->size & ~MAPPED_MASK) - ((char *) (_b) - MAPPED_BASE(_b)) - BHDR_OVERHEAD)
+
+/*  映射块的整个映射长度计入used_size；不在内存池中，free_size不变*/
+#if TLSF_STATISTIC
+#define	MAPPED_ADD_SIZE(tlsf, _len) do {			tlsf->used_size += (_len);			if (tlsf->used_size > tlsf->max_size)				tlsf->max_size = tlsf->used_size;		} while(0)
+#define	MAPPED_REMOVE_SIZE(tlsf, _len)  (tlsf->used_size -= (_len))
+#else
+#define	MAPPED_ADD_SIZE(tlsf, _len)     do{}while(0)
+#define	MAPPED_REMOVE_SIZE(tlsf, _len)  do{}while(0)
+#endif
+
+static void *mapped_alloc(tlsf_t *tlsf, size_t size, size_t align)
+{
+    size_t len;
+    char *area;
+    bhdr_t *b;
+
+    if (align < BLOCK_ALIGN)
+        align = BLOCK_ALIGN;
+    if (align > (size_t) PAGE_SIZE || size > SIZE_MAX - align - PAGE_SIZE)
+        return NULL;
+    len = ROUNDUP(size + align, (size_t) PAGE_SIZE);
+    area = mmap(0, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (area == MAP_FAILED) {
+        TLSF_STAT_INC(tlsf, size, fail_cnt);
+        return NULL;
+    }
+    b = (bhdr_t *) (area + align - BHDR_OVERHEAD);
+    b->size = len | MAPPED_BLOCK | USED_BLOCK | PREV_USED;
+    MAPPED_ADD_SIZE(tlsf, len);
+    TLSF_STAT_INC(tlsf, MAPPED_CAP(b), alloc_cnt);
+#if TLSF_STATISTIC_EXT
+    tlsf->req_size += size;
+    tlsf->grant_size += MAPPED_CAP(b);
+#endif
+    return (void *) b->ptr.buffer;
+}
+
+static void mapped_free(tlsf_t *tlsf, bhdr_t *b)
+{
+    MAPPED_REMOVE_SIZE(tlsf, b->size & ~MAPPED_MASK);
+    TLSF_STAT_INC(tlsf, MAPPED_CAP(b), free_cnt);
+    munmap(MAPPED_BASE(b), b->size & ~MAPPED_MASK);
+}
+
+/*  映射块改变大小：新大小仍超过阈值时用mremap()移动页面，否则搬回内存池*/
+static void *mapped_realloc(bhdr_t *b, size_t new_size, void *mem_pool)
+{
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    char *base = MAPPED_BASE(b), *area;
+    size_t off = (char *) b - base, len = b->size & ~MAPPED_MASK;
+    size_t cap = len - off - BHDR_OVERHEAD;
+    void *ptr;
+
+    if (new_size >= TLSF_MMAP_THRESHOLD && new_size <= SIZE_MAX - off - PAGE_SIZE) {
+#ifdef MREMAP_MAYMOVE
+        size_t new_len = ROUNDUP(new_size + off + BHDR_OVERHEAD, (size_t) PAGE_SIZE);
+
+        if (new_len == len)
+            return (void *) b->ptr.buffer;
+        area = mremap(base, len, new_len, MREMAP_MAYMOVE);
+        if (area == MAP_FAILED)
+            return NULL;
+        b = (bhdr_t *) (area + off);
+        b->size = new_len | MAPPED_BLOCK | USED_BLOCK | PREV_USED;
+        MAPPED_REMOVE_SIZE(tlsf, len);
+        MAPPED_ADD_SIZE(tlsf, new_len);
+        TLSF_STAT_INC(tlsf, MAPPED_CAP(b), realloc_inplace_cnt);
+        return (void *) b->ptr.buffer;
+#else
+        if (new_size <= cap)
+            return (void *) b->ptr.buffer;
+#endif
+    }
+    if (!(ptr = malloc_ex(new_size, mem_pool)))
+        return NULL;
+    bulk_copy(ptr, b->ptr.buffer, (new_size < cap) ? new_size : cap);
+    mapped_free(tlsf, b);
+    return ptr;
+}
+#endif
+
+/* 函数功能：ex内存分配函数，实际内存分配函数
+   形参：   size  所需内存的大小； men_pool  内存池的首地址
+   返回：   viod *  （无符号指针）。分配成功后，返回内存块的指针ret；分配失败返回NULL。
+*/
+/******************************************************************/
+void *malloc_ex(size_t size, void *mem_pool)
+{
+/******************************************************************/
+    void *ret;
+    int fl, sl;
+#if TLSF_STATISTIC_EXT
+    size_t req_size = size;
+#endif
+
+    if (size > MAX_REQUEST) {         /* 取整会溢出，或一定超出一级索引范围 */
+        TLSF_STAT_INC(((tlsf_t *) mem_pool), size, fail_cnt);
+        return NULL;
+    }
+	/*  调整size值，最小为MIN_BLOCK_SIZE，最小（sizeof(free_ptr_t)）*/
+    size = (size < MIN_BLOCK_SIZE) ? MIN_BLOCK_SIZE : ROUNDUP_SIZE(size);
+
+#if TLSF_MMAP_THRESHOLD
+    if (size >= TLSF_MMAP_THRESHOLD)
+        return mapped_alloc((tlsf_t *) mem_pool, size, BLOCK_ALIGN);
+#endif
+
+    /* Rounding up the requested size and calculating fl and sl */
     MAPPING_SEARCH(&size, &fl, &sl);  /* 查找满足所需内存大小的一级与二级索引，size的值被调整为所需状态*/
+    if (fl >= REAL_FLI) {             /* 超出一级索引范围的请求，不能访问matrix */
+        TLSF_STAT_INC(((tlsf_t *) mem_pool), size, fail_cnt);
+        return NULL;
+    }
+
+    ret = malloc_class_ex(size, fl, sl, mem_pool);
+#if TLSF_WATERMARK
+    if (!ret && ((tlsf_t *) mem_pool)->wm.reclaim) {   /* 让使用者释放缓存后重试 */
+        tlsf_t *tlsf = (tlsf_t *) mem_pool;
+        int retry;
+
+        for (retry = 0; !ret && retry < TLSF_RECLAIM_RETRY; retry++) {
+            if (!tlsf->wm.reclaim(mem_pool, size, tlsf->wm.arg))
+                break;
+            MAPPING_SEARCH(&size, &fl, &sl);
+            ret = malloc_class_ex(size, fl, sl, mem_pool);
+        }
+    }
+#endif
+#if TLSF_STATISTIC_EXT
+    if (ret)
+        TLSF_STAT_GRANT(((tlsf_t *) mem_pool), req_size, ((bhdr_t *) ((char *) ret - BHDR_OVERHEAD)));
+#endif
+    return ret;
+}
+
+/* 函数功能：按已算好的大小类分配，跳过ROUNDUP_SIZE与MAPPING_SEARCH
+   形参：   size  已经过ROUNDUP_SIZE与MAPPING_SEARCH调整的大小；fl/sl  MAPPING_SEARCH得到的索引
+            （可由tlsf.hpp中的 tlsf::size_class<> 在编译期算出）； men_pool  内存池的首地址
+   返回：   分配成功后，返回内存块的指针；分配失败返回NULL。
+*/
+/******************************************************************/
+void *malloc_class_ex(size_t size, int fl, int sl, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    bhdr_t *b;
+#if !TLSF_TAIL_SPLIT
+    bhdr_t *b2, *next_b;
+    size_t tmp_size;
+#endif
+
+    if (POOL_POISONED(tlsf))
+        return NULL;
+#if TLSF_QUICKLIST
+    if (fl < TLSF_QUICK_FLI && (b = QUICK(tlsf, fl, sl))) { /* 同一大小类有未合并的块，直接取出 */
+        SET_QUICK(tlsf, fl, sl, FREE_NEXT(b));
+        tlsf->quick_cnt--;
+        TLSF_ADD_SIZE(tlsf, b);
+        TLSF_STAT_INC(tlsf, size, alloc_cnt);
+        TLSF_WATERMARK_CHECK(tlsf);
+        return (void *) b->ptr.buffer;
+    }
+#endif
 
     /* Searching a free block, recall that this function changes the values of fl and sl,
        so they are not longer valid when the function fails */
     b = FIND_SUITABLE_BLOCK(tlsf, &fl, &sl);  /* 根据fl与sl的值得到适合的内存块的链表的表头*/
+#if TLSF_QUICKLIST
+    if (!b && tlsf->quick_cnt) {   /* 先合并快速链表中的块再找一次 */
+        quick_flush(tlsf);
+        MAPPING_SEARCH(&size, &fl, &sl);
+        b = FIND_SUITABLE_BLOCK(tlsf, &fl, &sl);
+    }
+#endif
+    if (!b && tlsf->warm_cnt) {    /* 合并预热时留下的相邻空闲块再找一次 */
+        warm_merge(tlsf);
+        MAPPING_SEARCH(&size, &fl, &sl);
+        b = FIND_SUITABLE_BLOCK(tlsf, &fl, &sl);
+    }
 	
 	/* 以下部分是用于当前内存池中，没有所需内存块时，从内存中得到新的内存区（使用sbrk or mmap函数）*/
 #if USE_MMAP || USE_SBRK
     if (!b) {
-        size_t area_size;
-        void *area;
         /* Growing the pool size when needed */
-        area_size = size + BHDR_OVERHEAD * 8;   /* size plus enough room for the requered headers. */
-        area_size = (area_size > DEFAULT_AREA_SIZE) ? area_size : DEFAULT_AREA_SIZE; /* area_size最小值为DEFAULT_AREA_SIZE，避免分割出太多的小内存区*/
-        area = get_new_area(&area_size);        /* Call sbrk or mmap */
-        if (area == ((void *) ~0))
+        if (!grow_pool(tlsf, size))
             return NULL;        /* Not enough system memory */
-        add_new_area(area, area_size, mem_pool);
         /* Rounding up the requested size and calculating fl and sl */
         MAPPING_SEARCH(&size, &fl, &sl);
         /* Searching a free block */
         b = FIND_SUITABLE_BLOCK(tlsf, &fl, &sl);
     }
 #endif
-    if (!b)    /* 如果b空闲链表表头为NULL，表示分配内存失败！*/
+    if (!b) {  /* 如果b空闲链表表头为NULL，表示分配内存失败！*/
+        TLSF_STAT_INC(tlsf, size, fail_cnt);
         return NULL;            /* Not found */
+    }
 
+#if TLSF_TAIL_SPLIT
+    b = carve_tail(tlsf, b, size, fl, sl);
+#else
     EXTRACT_BLOCK_HDR(b, tlsf, fl, sl);  /* 根据一级与二级索引值，从相应链表中得到内存块，并调整bitmap位图*/
     /*-- found: */
     next_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE); /* 根据b->size得到next的物理相邻内存块*/
@@ -919,21 +2732,25 @@ void *malloc_ex(size_t size, void *mem_pool)
         tmp_size -= BHDR_OVERHEAD;    
         b2 = GET_NEXT_BLOCK(b->ptr.buffer, size); /* 得到剩余内存块的地址*/
         b2->size = tmp_size | FREE_BLOCK | PREV_USED;  /* 为分割下来的内存块的size赋值*/
-        next_b->prev_hdr = b2;            /* next_b内存块链接相邻的前一个物理内存块*/
+        SET_PREV_HDR(next_b, b2);            /* next_b内存块链接相邻的前一个物理内存块*/
         MAPPING_INSERT(tmp_size, &fl, &sl); /* 查找剩余内存块的空闲链表的一级与二级索引值*/
         INSERT_BLOCK(b2, tlsf, fl, sl);    /*  插入内存块，且总是查入表头*/
        
 		/* 更新b2块的前一块的内存地址，*/
-       /*add by vector,right?*/ b2->prev_hdr = b;
+       /*add by vector,right?*/ SET_PREV_HDR(b2, b);
 		
 		/*  size后两位更新，只把0bit改为USED_BLOCK*/
         b->size = size | (b->size & PREV_STATE); /* 参数size为所需内存大小，更新b块的状态*/ 
+        TLSF_STAT_INC(tlsf, size, split_cnt);
     } else {      /* 所得内存块不需要分割，只需更新size的后两位*/
         next_b->size &= (~PREV_FREE);   
         b->size &= (~FREE_BLOCK);       /* Now it's used */
     }
+#endif
 
     TLSF_ADD_SIZE(tlsf, b);
+    TLSF_STAT_INC(tlsf, size, alloc_cnt);
+    TLSF_WATERMARK_CHECK(tlsf);
 		
 		if (tlsf->used_size > DM_MEM_SIZE)
 			mem_errorno = 0x03;
@@ -941,68 +2758,461 @@ void *malloc_ex(size_t size, void *mem_pool)
     return (void *) b->ptr.buffer;
 }
 
-/* 函数功能：释放ftr所在的内存块，并根据情况合并前后内存块，更新相应bitmap标志位
-   形参：   ptr  释放内存指针； men_pool  内存池的首地址
-   返回：   viod *  （无符号指针）。分配成功后，返回内存块的指针ret；分配失败返回NULL。
+/* 函数功能：已分配内存块实际可用的字节数（ROUNDUP_SIZE、MAPPING_SEARCH的取整以及
+             未分割出去的剩余部分都可以使用），不需要内存池，也不上锁
+   形参：   ptr  malloc_ex等返回的指针
+   返回：   可用字节数，ptr为NULL时返回0
 */
-/* */
 /******************************************************************/
-void free_ex(void *ptr, void *mem_pool)
+size_t tlsf_usable_size(void *ptr)
 {
 /******************************************************************/
-    tlsf_t *tlsf = (tlsf_t *) mem_pool;
-    bhdr_t *b, *tmp_b;
-    int fl = 0, sl = 0;
+    bhdr_t *b;
 
-    if (!ptr) {   /*ptr为NULL，直接返回*/
-        return;
-    }
+    if (!ptr)
+        return 0;
     b = (bhdr_t *) ((char *) ptr - BHDR_OVERHEAD);
-    b->size |= FREE_BLOCK; /* 所释放内存块状态更新（size后两位更新）*/
-
-    TLSF_REMOVE_SIZE(tlsf, b);  /*  #if TLSF_STATISTIC */
-
-    b->ptr.free_ptr.prev = NULL;
-    b->ptr.free_ptr.next = NULL;
-    tmp_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE); /* 得到b块后面的相邻物理块指针*/
-    if (tmp_b->size & FREE_BLOCK) { /*  b块后面块是free的？其后内存块free则合并内存*/
-        MAPPING_INSERT(tmp_b->size & BLOCK_SIZE, &fl, &sl); /* 根据tmp_b大小求出一级与二级索引值*/
-        EXTRACT_BLOCK(tmp_b, tlsf, fl, sl); /*  提取内存块，并根据内存块在链表中的位置调整空闲链表与位图标志位*/
-        b->size += (tmp_b->size & BLOCK_SIZE) + BHDR_OVERHEAD;  /* 把b（ptr）后面的内存块合并到b内存块中，size更新*/
-    }
-    if (b->size & PREV_FREE) {  /* b块前一块free？free则与前面的内存块合并*/
-        tmp_b = b->prev_hdr;    /* 得到b块前1物理块 */
-        MAPPING_INSERT(tmp_b->size & BLOCK_SIZE, &fl, &sl);
-        EXTRACT_BLOCK(tmp_b, tlsf, fl, sl);
-        tmp_b->size += (b->size & BLOCK_SIZE) + BHDR_OVERHEAD;
-        b = tmp_b;   /* 更新b指针的值，即b指向合并后的内存块地址*/
-    }
-    MAPPING_INSERT(b->size & BLOCK_SIZE, &fl, &sl); /**/
-    INSERT_BLOCK(b, tlsf, fl, sl);  /*  把释放的内存块插入相应链表的表头*/
-
-    tmp_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
-    tmp_b->size |= PREV_FREE;    /* 更新后一块的信息，以表示释放的内存块空闲的*/
-    tmp_b->prev_hdr = b;         /*  更新后一块内存块的物理块prev_hdr*/ 
-		
-		if (tlsf->used_size > DM_MEM_SIZE)
-			mem_errorno = 0x02;
+#if TLSF_MMAP_THRESHOLD
+    if (b->size & MAPPED_BLOCK)
+        return MAPPED_CAP(b);
+#endif
+    return b->size & BLOCK_SIZE;
 }
 
-
-/* 函数功能：内存扩充函数
-   形参：   ptr原内存块的指针地址； new_size  扩充后内存的大小； men_pool  内存池的首地址
-   返回：   viod *  （无符号指针）。分配成功后，返回内存块的指针；分配失败返回NULL。
+/* 函数功能：分配内存并返回实际得到的大小，调用者（动态数组、字符串等）可以用满整个块，
+             减少realloc
+   形参：   size  所需内存的大小； granted  存放实际可用的字节数（失败时为0）； men_pool  内存池的首地址
+   返回：   分配成功后，返回内存块的指针；分配失败返回NULL。
 */
 /******************************************************************/
-void *realloc_ex(void *ptr, size_t new_size, void *mem_pool)
+void *malloc_size_ex(size_t size, size_t *granted, void *mem_pool)
 {
 /******************************************************************/
-    tlsf_t *tlsf = (tlsf_t *) mem_pool;
-    void *ptr_aux;
-    unsigned int cpsize;
-    bhdr_t *b, *tmp_b, *next_b;
-    int fl, sl;
-    size_t tmp_size;
+    void *ret = malloc_ex(size, mem_pool);
+
+    *granted = tlsf_usable_size(ret);
+    return ret;
+}
+
+#if TLSF_WAIT
+/*  等待者w的大小类现在能否分配成功，与FIND_SUITABLE_BLOCK的查找相同*/
+static int waiter_fits(tlsf_t *tlsf, const waiter_t *w)
+{
+#if TLSF_QUICKLIST
+    if (w->fl < TLSF_QUICK_FLI && QUICK(tlsf, w->fl, w->sl))
+        return 1;
+#endif
+    if (tlsf->sl_bitmap[w->fl] & (~(bitmap_t) 0 << w->sl))
+        return 1;
+    return ls_bit(tlsf->fl_bitmap & (~(bitmap_t) 0 << (w->fl + 1))) > 0;
+}
+
+/*  按队列顺序唤醒第一个现在能分配成功的等待者。同一时刻只有一个被唤醒的等待者，
+    它重新分配之后再唤醒下一个，避免所有等待者一起醒来争抢同一块内存*/
+static void wake_waiters(tlsf_t *tlsf)
+{
+    waiter_t *w;
+
+    for (w = tlsf->waiters; w; w = w->next)
+        if (w->signalled)
+            return;
+    for (;;) {
+        for (w = tlsf->waiters; w; w = w->next) {
+            if (waiter_fits(tlsf, w)) {
+                w->signalled = 1;
+                tlsf_waiter_wake(&tlsf->waitq, &w->wait);
+                return;
+            }
+        }
+#if TLSF_QUICKLIST
+        if (tlsf->quick_cnt) {      /* 合并快速链表后再看一次 */
+            quick_flush(tlsf);
+            continue;
+        }
+#endif
+        if (warm_merge(tlsf))       /* 预热留下的相邻空闲块也一样 */
+            continue;
+        return;
+    }
+}
+
+/* 函数功能：分配内存，内存不足时在内存池的等待队列上睡眠，直到释放出够用的空闲块或超时。
+            自己上锁，调用时不能持有内存池的锁
+   形参：   size  所需内存的大小； timeout  最长等待时间（见TLSF_WAIT_FOREVER），0为不等待；
+            prio  TLSF_WAIT_PRIO为1时的排队优先级，越大越先唤醒； men_pool  内存池的首地址
+   返回：   分配成功后，返回内存块的指针；超时、请求超出内存池范围或等待者过多时返回NULL。
+*/
+/******************************************************************/
+void *malloc_wait_ex(size_t size, unsigned long timeout, int prio, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    waiter_t w, **pw;
+    size_t class_size;
+    void *ret;
+    int woken;
+
+    TLSF_ACQUIRE_LOCK(&tlsf->lock);
+    ret = malloc_ex(size, mem_pool);
+    if (ret || !timeout || size > MAX_REQUEST)
+        goto out;
+
+    class_size = (size < MIN_BLOCK_SIZE) ? MIN_BLOCK_SIZE : ROUNDUP_SIZE(size);
+#if TLSF_MMAP_THRESHOLD
+    if (class_size >= TLSF_MMAP_THRESHOLD)  /* 不从内存池分配，等不到 */
+        goto out;
+#endif
+    MAPPING_SEARCH(&class_size, &w.fl, &w.sl);
+    if (w.fl >= REAL_FLI || !tlsf_waiter_init(&tlsf->waitq, &w.wait, timeout))
+        goto out;
+    w.prio = prio;
+    w.signalled = 0;
+    for (pw = &tlsf->waiters; *pw && (!TLSF_WAIT_PRIO || (*pw)->prio >= prio); pw = &(*pw)->next)
+        ;
+    w.next = *pw;
+    *pw = &w;
+
+    do {
+        TLSF_RELEASE_LOCK(&tlsf->lock);
+        woken = tlsf_waiter_sleep(&tlsf->waitq, &w.wait);
+        TLSF_ACQUIRE_LOCK(&tlsf->lock);
+        w.signalled = 0;
+        ret = malloc_ex(size, mem_pool);    /* 超时了也最后再试一次 */
+        if (!ret && woken)
+            wake_waiters(tlsf);             /* 被别人抢先了，让别的等待者试试 */
+    } while (!ret && woken);
+
+    for (pw = &tlsf->waiters; *pw != &w; pw = &(*pw)->next)
+        ;
+    *pw = w.next;
+    tlsf_waiter_destroy(&tlsf->waitq, &w.wait);
+    TLSF_WAIT_WAKE(tlsf);                   /* 剩下的内存也许够下一个等待者 */
+out:
+    TLSF_RELEASE_LOCK(&tlsf->lock);
+    return ret;
+}
+#endif
+
+/*  从空闲块b（空闲链表(fl,sl)的表头）的尾部分出size字节的已用块，前部剩余的仍为空闲块，
+    块头不动。剩余部分仍属于同一大小类时b留在原链表中，不需要任何链表与位图操作*/
+static bhdr_t *carve_tail(tlsf_t *tlsf, bhdr_t *b, size_t size, int fl, int sl)
+{
+    bhdr_t *u, *next_b;
+    size_t tmp_size = (b->size & BLOCK_SIZE) - size;
+    int rfl, rsl;
+
+    next_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
+    if (tmp_size < sizeof(bhdr_t)) {    /* 剩余部分放不下一个块，整块分配 */
+        EXTRACT_BLOCK_HDR(b, tlsf, fl, sl);
+        next_b->size &= ~PREV_FREE;
+        b->size &= ~FREE_BLOCK;
+        return b;
+    }
+    tmp_size -= BHDR_OVERHEAD;
+    MAPPING_INSERT(tmp_size, &rfl, &rsl);
+    if (rfl != fl || rsl != sl) {
+        EXTRACT_BLOCK_HDR(b, tlsf, fl, sl);
+        b->size = tmp_size | FREE_BLOCK | (b->size & PREV_STATE);
+        INSERT_BLOCK(b, tlsf, rfl, rsl);
+    } else
+        b->size = tmp_size | FREE_BLOCK | (b->size & PREV_STATE);
+    u = GET_NEXT_BLOCK(b->ptr.buffer, tmp_size);
+    u->size = size | USED_BLOCK | PREV_FREE;
+    SET_PREV_HDR(u, b);
+    SET_PREV_HDR(next_b, u);
+    next_b->size &= ~PREV_FREE;
+    TLSF_STAT_INC(tlsf, size, split_cnt);
+    return u;
+}
+
+/* 函数功能：按预计的生存期分配，把长期存在的块与临时块分开，减少碎片
+             TLSF_LIFE_SHORT      同malloc_ex，从空闲块的低地址端分配
+             TLSF_LIFE_LONG       最合适的空闲块，但从其高地址端分配
+             TLSF_LIFE_PERMANENT  最大的空闲块（通常是内存区末尾未用过的部分），从其高地址端分配
+             长期块因此集中在内存区高端，临时块在低端，释放后的空闲块能合并成大块。仍为O(1)
+   形参：   size  所需内存的大小； hint  生存期； men_pool  内存池的首地址
+   返回：   分配成功后，返回内存块的指针；分配失败返回NULL。
+*/
+/******************************************************************/
+void *malloc_hint_ex(size_t size, int hint, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    bhdr_t *b = NULL;
+    size_t req_size = size;
+    int fl, sl;
+
+    if (hint == TLSF_LIFE_SHORT || POOL_POISONED(tlsf))
+        return malloc_ex(size, mem_pool);
+#if TLSF_MMAP_THRESHOLD
+    if (size >= TLSF_MMAP_THRESHOLD)
+        return malloc_ex(size, mem_pool);
+#endif
+
+    if (size > MAX_REQUEST)
+        return malloc_ex(size, mem_pool);   /* 失败，由malloc_ex()计数 */
+    size = (size < MIN_BLOCK_SIZE) ? MIN_BLOCK_SIZE : ROUNDUP_SIZE(size);
+    if (hint == TLSF_LIFE_PERMANENT && tlsf->fl_bitmap) {
+        fl = ms_bit(tlsf->fl_bitmap);
+        sl = ms_bit(tlsf->sl_bitmap[fl]);
+        b = MATRIX(tlsf, fl, sl);
+        if ((b->size & BLOCK_SIZE) < size)
+            b = NULL;
+    }
+    if (!b) {
+        MAPPING_SEARCH(&size, &fl, &sl);
+        if (fl < REAL_FLI)
+            b = FIND_SUITABLE_BLOCK(tlsf, &fl, &sl);
+    }
+    if (!b)     /* 找不到时走普通路径（快速链表、回收回调、扩充内存区） */
+        return malloc_ex(req_size, mem_pool);
+
+    b = carve_tail(tlsf, b, size, fl, sl);
+
+    TLSF_ADD_SIZE(tlsf, b);
+    TLSF_STAT_INC(tlsf, size, alloc_cnt);
+    TLSF_STAT_GRANT(tlsf, req_size, b);
+    TLSF_WATERMARK_CHECK(tlsf);
+    return (void *) b->ptr.buffer;
+}
+
+/* 函数功能：按大小类剖析预热内存池。刚初始化的内存池只有一个大空闲块，每种大小的头几次分配
+            都要分割它，要运行一段时间才能进入稳定状态。这里按剖析（如记录的分配轨迹的汇总，
+            或tlsf_snap -w 从快照得到的表）为每个热点大小预先从最大的空闲块尾部切出
+            count个正好合适的空闲块，放入malloc_ex()会首先查找的空闲链表matrix[fl][sl]，
+            之后这些大小的分配不再需要分割，且同类的块集中在一起。
+            预切的块相邻也不合并（记入warm_cnt），找不到合适的块时malloc_ex()先用
+            warm_merge()把它们并回去再找
+   形参：   mem_pool  内存池的首地址； prof  剖析表（热点在前）； n  表项数
+   返回：   预切的块数，最大的空闲块不够再切时提前停止
+*/
+/******************************************************************/
+size_t warm_pool_ex(void *mem_pool, const tlsf_warm_t *prof, int n)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    bhdr_t *b, *next_b;
+    size_t size, i, done = 0;
+    int fl, sl, bfl, bsl;
+
+    if (POOL_POISONED(tlsf))
+        return 0;
+    for (; n > 0; n--, prof++) {
+        if (prof->size > POOL_MAX_REQUEST)
+            continue;
+        size = (prof->size < MIN_BLOCK_SIZE) ? MIN_BLOCK_SIZE : ROUNDUP_SIZE(prof->size);
+#if TLSF_MMAP_THRESHOLD
+        if (size >= TLSF_MMAP_THRESHOLD)
+            continue;
+#endif
+        MAPPING_SEARCH(&size, &fl, &sl);    /* size成为(fl,sl)的下界，分配时正好整块取走 */
+        if (fl >= REAL_FLI)
+            continue;
+        for (i = 0; i < prof->count; i++) {
+            if (!tlsf->fl_bitmap)
+                return done;
+            bfl = ms_bit(tlsf->fl_bitmap);
+            bsl = ms_bit(tlsf->sl_bitmap[bfl]);
+            b = MATRIX(tlsf, bfl, bsl);
+            if ((b->size & BLOCK_SIZE) < size + sizeof(bhdr_t))
+                return done;                /* 最大的空闲块也不够切了 */
+            b = carve_tail(tlsf, b, size, bfl, bsl);
+
+            b->size |= FREE_BLOCK;          /* 不合并，直接放回空闲链表 */
+            SET_FREE_PREV(b, NULL);
+            SET_FREE_NEXT(b, NULL);
+            INSERT_BLOCK(b, tlsf, fl, sl);
+            next_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
+            next_b->size |= PREV_FREE;
+            SET_PREV_HDR(next_b, b);
+            tlsf->warm_cnt++;
+            done++;
+        }
+    }
+    return done;
+}
+
+/* 函数功能：释放ftr所在的内存块，并根据情况合并前后内存块，更新相应bitmap标志位
+   形参：   ptr  释放内存指针； men_pool  内存池的首地址
+   返回：   viod *  （无符号指针）。分配成功后，返回内存块的指针ret；分配失败返回NULL。
+*/
+/* */
+/******************************************************************/
+void free_ex(void *ptr, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    bhdr_t *b;
+#if TLSF_QUICKLIST
+    int fl, sl;
+#endif
+
+    if (!ptr || POOL_POISONED(tlsf)) {   /*ptr为NULL，直接返回*/
+        return;
+    }
+    b = (bhdr_t *) ((char *) ptr - BHDR_OVERHEAD);
+#if TLSF_MMAP_THRESHOLD
+    if (b->size & MAPPED_BLOCK) {
+        mapped_free(tlsf, b);
+        return;
+    }
+#endif
+
+    TLSF_REMOVE_SIZE(tlsf, b);  /*  #if TLSF_STATISTIC */
+    TLSF_STAT_INC(tlsf, b->size & BLOCK_SIZE, free_cnt);
+
+#if TLSF_QUICKLIST
+    if ((b->size & BLOCK_SIZE) < QUICK_MAX_SIZE) {
+        if (tlsf->quick_cnt >= TLSF_QUICK_LIMIT)
+            quick_flush(tlsf);
+        else {          /* 不合并，保持已用状态放入快速链表 */
+            MAPPING_INSERT(b->size & BLOCK_SIZE, &fl, &sl);
+            SET_FREE_NEXT(b, QUICK(tlsf, fl, sl));
+            SET_QUICK(tlsf, fl, sl, b);
+            tlsf->quick_cnt++;
+            TLSF_WATERMARK_CHECK(tlsf);
+            TLSF_WAIT_WAKE(tlsf);
+            return;
+        }
+    }
+#endif
+    b = merge_block(tlsf, b);
+#if AREA_TRIM
+    if (!(GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE)->size & BLOCK_SIZE))
+        trim_area(tlsf, b);     /* 内存区的最后一块 */
+#endif
+    TLSF_WATERMARK_CHECK(tlsf);
+    TLSF_WAIT_WAKE(tlsf);
+
+		if (tlsf->used_size > DM_MEM_SIZE)
+			mem_errorno = 0x02;
+}
+
+/*  把已用块b标为空闲，与前后空闲块合并后插入空闲链表，返回合并后的块*/
+static bhdr_t *merge_block(tlsf_t *tlsf, bhdr_t *b)
+{
+    bhdr_t *tmp_b;
+    int fl = 0, sl = 0;
+
+    b->size |= FREE_BLOCK; /* 所释放内存块状态更新（size后两位更新）*/
+    SET_FREE_PREV(b, NULL);
+    SET_FREE_NEXT(b, NULL);
+    tmp_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE); /* 得到b块后面的相邻物理块指针*/
+    if (tmp_b->size & FREE_BLOCK) { /*  b块后面块是free的？其后内存块free则合并内存*/
+        MAPPING_INSERT(tmp_b->size & BLOCK_SIZE, &fl, &sl); /* 根据tmp_b大小求出一级与二级索引值*/
+        EXTRACT_BLOCK(tmp_b, tlsf, fl, sl); /*  提取内存块，并根据内存块在链表中的位置调整空闲链表与位图标志位*/
+        b->size += (tmp_b->size & BLOCK_SIZE) + BHDR_OVERHEAD;  /* 把b（ptr）后面的内存块合并到b内存块中，size更新*/
+        TLSF_STAT_INC(tlsf, b->size & BLOCK_SIZE, merge_cnt);
+        TLSF_CURSOR_MERGED(tlsf, tmp_b, b);
+    }
+    if (b->size & PREV_FREE) {  /* b块前一块free？free则与前面的内存块合并*/
+        tmp_b = PREV_HDR(b);    /* 得到b块前1物理块 */
+        MAPPING_INSERT(tmp_b->size & BLOCK_SIZE, &fl, &sl);
+        EXTRACT_BLOCK(tmp_b, tlsf, fl, sl);
+        tmp_b->size += (b->size & BLOCK_SIZE) + BHDR_OVERHEAD;
+        TLSF_CURSOR_MERGED(tlsf, b, tmp_b);
+        b = tmp_b;   /* 更新b指针的值，即b指向合并后的内存块地址*/
+        TLSF_STAT_INC(tlsf, b->size & BLOCK_SIZE, merge_cnt);
+    }
+    MAPPING_INSERT(b->size & BLOCK_SIZE, &fl, &sl); /**/
+    INSERT_BLOCK(b, tlsf, fl, sl);  /*  把释放的内存块插入相应链表的表头*/
+
+    tmp_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
+    tmp_b->size |= PREV_FREE;    /* 更新后一块的信息，以表示释放的内存块空闲的*/
+    SET_PREV_HDR(tmp_b, b);         /*  更新后一块内存块的物理块prev_hdr*/ 
+    return b;
+}
+
+/*  合并warm_pool_ex()留下的相邻空闲块，恢复“没有相邻空闲块”的不变式，返回合并的次数。
+    按物理顺序遍历各内存区，每遇到后一块也空闲的空闲块，就把它取出当作刚释放的块交给merge_block()*/
+static int warm_merge(tlsf_t *tlsf)
+{
+    area_info_t *ai;
+    bhdr_t *b, *next_b;
+    int fl, sl, n = 0;
+
+    if (!tlsf->warm_cnt)
+        return 0;
+    for (ai = AREA_HEAD(tlsf); ai; ai = AREA_NEXT(ai)) {
+        b = (bhdr_t *) ((char *) ai - BHDR_OVERHEAD);
+        while (b->size & BLOCK_SIZE) {
+            next_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
+            if ((b->size & FREE_BLOCK) && (next_b->size & FREE_BLOCK)) {
+                MAPPING_INSERT(b->size & BLOCK_SIZE, &fl, &sl);
+                EXTRACT_BLOCK(b, tlsf, fl, sl);
+                b->size &= ~FREE_BLOCK;
+                next_b->size &= ~PREV_FREE;
+                b = merge_block(tlsf, b);   /* 前一块不是空闲的，b不变，再看新的后一块 */
+                n++;
+                continue;
+            }
+            b = next_b;
+        }
+    }
+    tlsf->warm_cnt = 0;
+    return n;
+}
+
+#if TLSF_QUICKLIST
+/*  合并快速链表中的全部块，返回处理的块数*/
+static int quick_flush(tlsf_t *tlsf)
+{
+    bhdr_t *b;
+    int fl, sl, n = tlsf->quick_cnt;
+
+    for (fl = 0; fl < TLSF_QUICK_FLI && tlsf->quick_cnt; fl++) {
+        for (sl = 0; sl < MAX_SLI; sl++) {
+            while ((b = QUICK(tlsf, fl, sl))) {
+                SET_QUICK(tlsf, fl, sl, FREE_NEXT(b));
+                merge_block(tlsf, b);
+            }
+        }
+    }
+    tlsf->quick_cnt = 0;
+    return n;
+}
+
+/* 函数功能：合并内存池快速链表中所有未合并的块（可在空闲时调用，减少碎片）
+   形参：   men_pool  内存池的首地址
+   返回：   合并的块数
+*/
+/******************************************************************/
+int flush_quick_lists_ex(void *mem_pool)
+{
+/******************************************************************/
+    return quick_flush((tlsf_t *) mem_pool);
+}
+
+/******************************************************************/
+int tlsf_flush_quick(void)
+{
+/******************************************************************/
+    int ret;
+
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+    ret = quick_flush((tlsf_t *) mp);
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+    return ret;
+}
+#endif
+
+
+/* 函数功能：内存扩充函数
+   形参：   ptr原内存块的指针地址； new_size  扩充后内存的大小； men_pool  内存池的首地址
+   返回：   viod *  （无符号指针）。分配成功后，返回内存块的指针；分配失败返回NULL。
+*/
+/******************************************************************/
+void *realloc_ex(void *ptr, size_t new_size, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    void *ptr_aux;
+    size_t cpsize;
+    bhdr_t *b, *next_b;
+    size_t tmp_size;
+#if TLSF_STATISTIC_EXT
+    size_t req_size = new_size;
+#endif
 
     if (!ptr) {  /* 如果ptr为NULL*/
         if (new_size)  /* 并且new_size不为0，realloc函数等同malloc函数使用*/
@@ -1013,56 +3223,31 @@ void *realloc_ex(void *ptr, size_t new_size, void *mem_pool)
         free_ex(ptr, mem_pool);
         return NULL;
     }
+    if (POOL_POISONED(tlsf))
+        return NULL;
 
     b = (bhdr_t *) ((char *) ptr - BHDR_OVERHEAD);
+#if TLSF_MMAP_THRESHOLD
+    if (b->size & MAPPED_BLOCK)
+        return mapped_realloc(b, new_size, mem_pool);
+#endif
+    if (new_size > MAX_REQUEST)
+        return NULL;
     next_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
     new_size = (new_size < MIN_BLOCK_SIZE) ? MIN_BLOCK_SIZE : ROUNDUP_SIZE(new_size); /* 新内存大小调整，8bit对齐*/
     tmp_size = (b->size & BLOCK_SIZE);   /* 原内存块大小*/
     if (new_size <= tmp_size) {  /*如果原内存块大小大于等于所需新内存的大小*/
-	   TLSF_REMOVE_SIZE(tlsf, b);  /* 统计函数相关*/
- 	   if (next_b->size & FREE_BLOCK) {  /*如果其后的内存块是free的*/
-            MAPPING_INSERT(next_b->size & BLOCK_SIZE, &fl, &sl);  /*得到next内存块的fl与sl值*/
-            EXTRACT_BLOCK(next_b, tlsf, fl, sl);                  /* 根据fl，sl的值提取next_block内存块，并更新bitmap位图*/
-            tmp_size += (next_b->size & BLOCK_SIZE) + BHDR_OVERHEAD;  /* */
-            next_b = GET_NEXT_BLOCK(next_b->ptr.buffer, next_b->size & BLOCK_SIZE);
-            /* We allways reenter this free block because tmp_size will
-               be greater then sizeof (bhdr_t) */
-        }
-        tmp_size -= new_size;
-        if (tmp_size >= sizeof(bhdr_t)) {
-            tmp_size -= BHDR_OVERHEAD;
-            tmp_b = GET_NEXT_BLOCK(b->ptr.buffer, new_size);
-            tmp_b->size = tmp_size | FREE_BLOCK | PREV_USED;
-            next_b->prev_hdr = tmp_b;
-            next_b->size |= PREV_FREE;
-            MAPPING_INSERT(tmp_size, &fl, &sl);
-            INSERT_BLOCK(tmp_b, tlsf, fl, sl);
-            b->size = new_size | (b->size & PREV_STATE);
-        }
-	TLSF_ADD_SIZE(tlsf, b);
+        resize_in_place(tlsf, b, new_size);
+        TLSF_STAT_INC(tlsf, new_size, realloc_inplace_cnt);
+        TLSF_STAT_GRANT(tlsf, req_size, b);
+        TLSF_WAIT_WAKE(tlsf);           /* 缩小后尾部还给了内存池 */
         return (void *) b->ptr.buffer;
     }
     if ((next_b->size & FREE_BLOCK)) { /* 如果新size大于原size，并且后一块free */
         if (new_size <= (tmp_size + (next_b->size & BLOCK_SIZE))) { /* 若后面空闲内存块够用，则从其后的空闲内存块中分配一块即可*/
-			TLSF_REMOVE_SIZE(tlsf, b);
-            MAPPING_INSERT(next_b->size & BLOCK_SIZE, &fl, &sl);
-            EXTRACT_BLOCK(next_b, tlsf, fl, sl);
-            b->size += (next_b->size & BLOCK_SIZE) + BHDR_OVERHEAD;
-            next_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
-            next_b->prev_hdr = b;
-            next_b->size &= ~PREV_FREE;
-            tmp_size = (b->size & BLOCK_SIZE) - new_size;
-            if (tmp_size >= sizeof(bhdr_t)) { /* 其后分割剩余的内存块大于sizeof(bhdr_t)，而为其组织为一个空闲块*/
-                tmp_size -= BHDR_OVERHEAD;
-                tmp_b = GET_NEXT_BLOCK(b->ptr.buffer, new_size);
-                tmp_b->size = tmp_size | FREE_BLOCK | PREV_USED;
-                next_b->prev_hdr = tmp_b;
-                next_b->size |= PREV_FREE;
-                MAPPING_INSERT(tmp_size, &fl, &sl);
-                INSERT_BLOCK(tmp_b, tlsf, fl, sl);
-                b->size = new_size | (b->size & PREV_STATE);
-            }
-			TLSF_ADD_SIZE(tlsf, b);
+            resize_in_place(tlsf, b, new_size);
+            TLSF_STAT_INC(tlsf, new_size, realloc_inplace_cnt);
+            TLSF_STAT_GRANT(tlsf, req_size, b);
             return (void *) b->ptr.buffer;
         }
     }
@@ -1073,15 +3258,124 @@ void *realloc_ex(void *ptr, size_t new_size, void *mem_pool)
     if (!(ptr_aux = malloc_ex(new_size, mem_pool))){ 
         return NULL;
     }      
+    TLSF_STAT_INC(tlsf, new_size, realloc_move_cnt);
     
     cpsize = ((b->size & BLOCK_SIZE) > new_size) ? new_size : (b->size & BLOCK_SIZE);  /* 调整cpsize值，即复制的字节数*/
 
-    memcpy(ptr_aux, ptr, cpsize); /* 把ptr中cpsize字节的数据复制到prt_aux处*/
+    bulk_copy(ptr_aux, ptr, cpsize); /* 把ptr中cpsize字节的数据复制到prt_aux处*/
 
     free_ex(ptr, mem_pool);  /* 如果前面的if都不成立，则执行释放原内存块*/
     return ptr_aux;          /* 返回调整后的内存块的指针*/
 }
 
+/*  把已分配的块b原地调整为new_size：后一块空闲时先把它并入，再把超出new_size的部分
+    分割为空闲块。调用者保证new_size不超过b与后一空闲块合起来的大小 */
+static void resize_in_place(tlsf_t *tlsf, bhdr_t *b, size_t new_size)
+{
+    bhdr_t *tmp_b, *next_b;
+    size_t tmp_size;
+    int fl, sl;
+
+    TLSF_REMOVE_SIZE(tlsf, b);
+    next_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
+    if (next_b->size & FREE_BLOCK) {  /*如果其后的内存块是free的*/
+        MAPPING_INSERT(next_b->size & BLOCK_SIZE, &fl, &sl);  /*得到next内存块的fl与sl值*/
+        EXTRACT_BLOCK(next_b, tlsf, fl, sl);                  /* 根据fl，sl的值提取next_block内存块，并更新bitmap位图*/
+        TLSF_CURSOR_MERGED(tlsf, next_b, b);
+        b->size += (next_b->size & BLOCK_SIZE) + BHDR_OVERHEAD;
+        next_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
+        SET_PREV_HDR(next_b, b);
+        next_b->size &= ~PREV_FREE;
+    }
+    tmp_size = (b->size & BLOCK_SIZE) - new_size;
+    if (tmp_size >= sizeof(bhdr_t)) { /* 分割剩余的内存块大于sizeof(bhdr_t)，而为其组织为一个空闲块*/
+        tmp_size -= BHDR_OVERHEAD;
+        tmp_b = GET_NEXT_BLOCK(b->ptr.buffer, new_size);
+        tmp_b->size = tmp_size | FREE_BLOCK | PREV_USED;
+        SET_PREV_HDR(next_b, tmp_b);
+        next_b->size |= PREV_FREE;
+        MAPPING_INSERT(tmp_size, &fl, &sl);
+        INSERT_BLOCK(tmp_b, tlsf, fl, sl);
+        b->size = new_size | (b->size & PREV_STATE);
+        TLSF_STAT_INC(tlsf, new_size, split_cnt);
+    }
+    TLSF_ADD_SIZE(tlsf, b);
+    TLSF_WATERMARK_CHECK(tlsf);
+}
+
+/* 函数功能：原地扩大内存块，绝不移动。只并入物理上紧随其后的空闲块，尽量扩大到max，
+             至少要达到min，多余部分仍还给内存池。块内的指针始终有效，适合环形缓冲、
+             arena等不能搬移的结构；做不到时由调用者自己决定是否另行分配
+   形参：   ptr  已分配内存的指针； min  至少需要的大小； max  希望的大小（小于min时按min）；
+            men_pool  内存池的首地址
+   返回：   扩大后实际可用的字节数（不小于min）；原地达不到min时返回0，内存块不变
+*/
+/******************************************************************/
+size_t try_expand_ex(void *ptr, size_t min, size_t max, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    bhdr_t *b, *next_b;
+    size_t size, avail;
+
+    if (!ptr || POOL_POISONED(tlsf))
+        return 0;
+    b = (bhdr_t *) ((char *) ptr - BHDR_OVERHEAD);
+#if TLSF_MMAP_THRESHOLD
+    if (b->size & MAPPED_BLOCK) {       /* 映射块不与相邻内存合并，只能用现有的大小 */
+        size = tlsf_usable_size(ptr);
+        return (size >= min) ? size : 0;
+    }
+#endif
+    size = b->size & BLOCK_SIZE;
+    avail = size;
+    next_b = GET_NEXT_BLOCK(b->ptr.buffer, size);
+    if (next_b->size & FREE_BLOCK)
+        avail += (next_b->size & BLOCK_SIZE) + BHDR_OVERHEAD;
+    if (min > avail)
+        return 0;
+    if (max > avail)                    /* avail已对齐，ROUNDUP_SIZE不会超出 */
+        max = avail;
+    if (max < min)
+        max = min;
+    max = ROUNDUP_SIZE(max);
+    if (max > size) {
+        resize_in_place(tlsf, b, max);
+        TLSF_STAT_INC(tlsf, max, realloc_inplace_cnt);
+    }
+    return b->size & BLOCK_SIZE;
+}
+
+/* 函数功能：原地缩小内存块，绝不移动。尾部分割为空闲块（与后面的空闲块合并）还给内存池，
+             size不小于当前大小时什么也不做
+   形参：   ptr  已分配内存的指针； size  缩小后所需的大小； men_pool  内存池的首地址
+   返回：   缩小后实际可用的字节数（尾部不够一个块头时保留在块内），ptr为NULL时返回0
+*/
+/******************************************************************/
+size_t shrink_in_place_ex(void *ptr, size_t size, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    bhdr_t *b;
+
+    if (!ptr || POOL_POISONED(tlsf))
+        return 0;
+    b = (bhdr_t *) ((char *) ptr - BHDR_OVERHEAD);
+#if TLSF_MMAP_THRESHOLD
+    if (b->size & MAPPED_BLOCK)
+        return tlsf_usable_size(ptr);
+#endif
+    if (size >= (b->size & BLOCK_SIZE))     /* 也避免ROUNDUP_SIZE回绕 */
+        return b->size & BLOCK_SIZE;
+    size = (size < MIN_BLOCK_SIZE) ? MIN_BLOCK_SIZE : ROUNDUP_SIZE(size);
+    if (size < (b->size & BLOCK_SIZE)) {
+        resize_in_place(tlsf, b, size);
+        TLSF_STAT_INC(tlsf, size, realloc_inplace_cnt);
+        TLSF_WAIT_WAKE(tlsf);
+    }
+    return b->size & BLOCK_SIZE;
+}
+
 
 /* 函数功能：calloc函数
    形参：   nelem  分配单元个数；eleme_size 单元大小； men_pool  内存池的首地址
@@ -1096,13 +3390,819 @@ void *calloc_ex(size_t nelem, size_t elem_size, void *mem_pool)
     if (nelem <= 0 || elem_size <= 0)
         return NULL;
 
+    if (nelem > SIZE_MAX / elem_size)
+        return NULL;
     if (!(ptr = malloc_ex(nelem * elem_size, mem_pool)))  /* 实际分配过程与malloc相同，使用malloc_ex函数分配*/
         return NULL;
-    memset(ptr, 0, nelem * elem_size); /* 分配成功后的内存块清零*/
+#if TLSF_MMAP_THRESHOLD
+    if (((bhdr_t *) ((char *) ptr - BHDR_OVERHEAD))->size & MAPPED_BLOCK)
+        return ptr;                     /* 新映射的匿名页已经是0 */
+#endif
+    bulk_zero(ptr, nelem * elem_size); /* 分配成功后的内存块清零*/
 
     return ptr;
 }
 
+/* 函数功能：对齐分配。多申请 align + sizeof(bhdr_t) 字节，把对齐点之前的部分
+             分割为独立的空闲块还给内存池，尾部多余部分同样分割释放，不浪费内存
+   形参：   align  对齐值（2的幂）； size  所需内存的大小； men_pool  内存池的首地址
+   返回：   分配成功返回对齐的内存块指针；对齐值非法或分配失败返回NULL
+   说明：   TLSF_MMAP_THRESHOLD时，多申请后达到阈值的请求单独映射；映射只能按页对齐，
+            align超过一页时仍从内存池分配（内存池放不下时失败）
+*/
+/******************************************************************/
+void *memalign_ex(size_t align, size_t size, void *mem_pool)
+{
+/******************************************************************/
+    bhdr_t *b, *ab, *tmp_b, *next_b;
+    size_t gap, tmp_size, pad;
+    char *ptr;
+#if TLSF_MMAP_THRESHOLD
+    int fl, sl;
+#endif
+
+    if (align & (align - 1))
+        return NULL;
+    if (align <= BLOCK_ALIGN)
+        return malloc_ex(size, mem_pool);
+    if (size > SIZE_MAX - align - sizeof(bhdr_t) - BLOCK_ALIGN)  /* 下面的取整与多申请不能溢出 */
+        return NULL;
+
+    size = (size < MIN_BLOCK_SIZE) ? MIN_BLOCK_SIZE : ROUNDUP_SIZE(size);
+    pad = size + align + sizeof(bhdr_t);
+#if TLSF_MMAP_THRESHOLD
+    if (pad >= TLSF_MMAP_THRESHOLD) {   /* malloc_ex()会单独映射多申请的块，不能在其中分割 */
+        if (align <= (size_t) PAGE_SIZE)
+            return mapped_alloc((tlsf_t *) mem_pool, size, align);
+        if (pad > POOL_MAX_REQUEST)     /* 对齐超过一页的映射块做不到，只能从内存池分配 */
+            return NULL;
+        MAPPING_SEARCH(&pad, &fl, &sl);
+        if (fl >= REAL_FLI || !(ptr = (char *) malloc_class_ex(pad, fl, sl, mem_pool)))
+            return NULL;
+    } else
+#endif
+    if (!(ptr = (char *) malloc_ex(pad, mem_pool)))
+        return NULL;
+
+    /* 对齐点之前的空隙要么为0，要么至少能放下一个空闲块*/
+    gap = ROUNDUP((unsigned long) ptr, align) - (unsigned long) ptr;
+    if (gap && gap < sizeof(bhdr_t))
+        gap += align;
+
+    b = (bhdr_t *) (ptr - BHDR_OVERHEAD);
+    if (gap) {
+        next_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
+        ab = GET_NEXT_BLOCK(b->ptr.buffer, gap - BHDR_OVERHEAD);
+        ab->size = ((b->size & BLOCK_SIZE) - gap) | USED_BLOCK | PREV_USED;
+        SET_PREV_HDR(ab, b);
+        SET_PREV_HDR(next_b, ab);
+        b->size = (gap - BHDR_OVERHEAD) | USED_BLOCK | (b->size & PREV_STATE);
+        free_ex(b->ptr.buffer, mem_pool);   /* 前部空隙还给内存池，ab的PREV_FREE在此设置*/
+        b = ab;
+    }
+
+    tmp_size = (b->size & BLOCK_SIZE) - size;
+    if (tmp_size >= sizeof(bhdr_t)) {      /* 尾部多余部分也分割出去*/
+        next_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
+        tmp_b = GET_NEXT_BLOCK(b->ptr.buffer, size);
+        tmp_b->size = (tmp_size - BHDR_OVERHEAD) | USED_BLOCK | PREV_USED;
+        SET_PREV_HDR(tmp_b, b);
+        SET_PREV_HDR(next_b, tmp_b);
+        b->size = size | (b->size & PREV_STATE);
+        free_ex(tmp_b->ptr.buffer, mem_pool);
+    }
+    return (void *) b->ptr.buffer;
+}
+
+#if TLSF_HANDLE
+/***************  句柄分配与碎片整理 **************/
+
+/* 句柄内存块的前 BLOCK_ALIGN 字节存放其表项序号，用户数据紧随其后。
+   遍历物理块时，只有表项序号有效且表项正指向本块的已用块才是句柄块，
+   普通 malloc_ex 的块不会被移动。*/
+#define HANDLE_DATA(_b)     ((void *) ((_b)->ptr.buffer + BLOCK_ALIGN))
+
+static __inline__ hentry_t *handle_entry(tlsf_t *tlsf, tlsf_handle_t h)
+{
+    if (h <= 0 || h > tlsf->hcount)
+        return NULL;
+    return LINK_GET(hentry_t, tlsf->htab) + (h - 1);
+}
+
+/*  已用块b是否为未锁定的句柄块*/
+static __inline__ int handle_movable(tlsf_t *tlsf, bhdr_t *b)
+{
+    size_t idx = *(size_t *) b->ptr.buffer;
+    hentry_t *e;
+
+    if (!tlsf->hcount || idx >= (size_t) tlsf->hcount)
+        return 0;
+    e = LINK_GET(hentry_t, tlsf->htab) + idx;
+    return LINK_GET(void, e->ptr) == HANDLE_DATA(b) && !e->pin;
+}
+
+/* 函数功能：建立内存池的句柄表，表本身从内存池中分配，不会被移动
+   形参：   count  句柄个数； men_pool  内存池的首地址
+   返回：   成功返回0，失败（已建立或内存不足）返回-1
+*/
+/******************************************************************/
+int init_handle_table(int count, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    hentry_t *tab;
+    int i;
+
+    if (tlsf->hcount || count <= 0)
+        return -1;
+    if (!(tab = (hentry_t *) malloc_ex(count * sizeof(hentry_t), mem_pool)))
+        return -1;
+    for (i = 0; i < count; i++) {
+        LINK_SET(tab[i].ptr, NULL);
+        tab[i].pin = (i + 1 < count) ? i + 1 : -1;
+    }
+    LINK_SET(tlsf->htab, tab);
+    tlsf->hcount = count;
+    tlsf->hfree = 0;
+    return 0;
+}
+
+/* 函数功能：分配一个可移动的内存块
+   返回：   句柄（>0），失败返回0。使用前以 hlock_ex() 得到地址
+*/
+/******************************************************************/
+tlsf_handle_t halloc_ex(size_t size, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    hentry_t *e;
+    char *ptr;
+    int idx = tlsf->hfree;
+
+    if (idx < 0 || !tlsf->hcount)
+        return 0;
+    if (!(ptr = (char *) malloc_ex(size + BLOCK_ALIGN, mem_pool)))
+        return 0;
+    e = LINK_GET(hentry_t, tlsf->htab) + idx;
+    tlsf->hfree = e->pin;
+    e->pin = 0;
+    *(size_t *) ptr = (size_t) idx;
+    LINK_SET(e->ptr, ptr + BLOCK_ALIGN);
+    return idx + 1;
+}
+
+/******************************************************************/
+void hfree_ex(tlsf_handle_t h, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    hentry_t *e = handle_entry(tlsf, h);
+
+    if (!e || !LINK_GET(void, e->ptr))
+        return;
+    free_ex((char *) LINK_GET(void, e->ptr) - BLOCK_ALIGN, mem_pool);
+    LINK_SET(e->ptr, NULL);
+    e->pin = tlsf->hfree;
+    tlsf->hfree = h - 1;
+}
+
+/* 函数功能：锁定句柄（可嵌套），返回数据地址；锁定期间内存块不会被移动
+*/
+/******************************************************************/
+void *hlock_ex(tlsf_handle_t h, void *mem_pool)
+{
+/******************************************************************/
+    hentry_t *e = handle_entry((tlsf_t *) mem_pool, h);
+
+    if (!e || !LINK_GET(void, e->ptr))
+        return NULL;
+    e->pin++;
+    return LINK_GET(void, e->ptr);
+}
+
+/******************************************************************/
+void hunlock_ex(tlsf_handle_t h, void *mem_pool)
+{
+/******************************************************************/
+    hentry_t *e = handle_entry((tlsf_t *) mem_pool, h);
+
+    if (e && e->pin > 0)
+        e->pin--;
+}
+
+/*  把已用块u移到其前面的空闲块f处，空闲空间移到u之后并与后面的空闲块合并 */
+static void slide_block(tlsf_t *tlsf, bhdr_t *f, bhdr_t *u)
+{
+    bhdr_t *r, *next_b;
+    size_t usize = u->size & BLOCK_SIZE, fsize = f->size & BLOCK_SIZE;
+    hentry_t *e = LINK_GET(hentry_t, tlsf->htab) + *(size_t *) u->ptr.buffer;
+    int fl, sl;
+
+    next_b = GET_NEXT_BLOCK(u->ptr.buffer, usize);
+    MAPPING_INSERT(fsize, &fl, &sl);
+    EXTRACT_BLOCK(f, tlsf, fl, sl);
+
+    memmove(f->ptr.buffer, u->ptr.buffer, usize);   /* 区域可能重叠 */
+    f->size = usize | USED_BLOCK | (f->size & PREV_STATE);
+    LINK_SET(e->ptr, HANDLE_DATA(f));
+
+    r = GET_NEXT_BLOCK(f->ptr.buffer, usize);       /* 空闲部分大小不变，只是位置后移 */
+    r->size = fsize | FREE_BLOCK | PREV_USED;
+    SET_PREV_HDR(r, f);
+    if (next_b->size & FREE_BLOCK) {
+        MAPPING_INSERT(next_b->size & BLOCK_SIZE, &fl, &sl);
+        EXTRACT_BLOCK(next_b, tlsf, fl, sl);
+        r->size += (next_b->size & BLOCK_SIZE) + BHDR_OVERHEAD;
+        next_b = GET_NEXT_BLOCK(r->ptr.buffer, r->size & BLOCK_SIZE);
+    }
+    SET_PREV_HDR(next_b, r);
+    next_b->size |= PREV_FREE;
+    MAPPING_INSERT(r->size & BLOCK_SIZE, &fl, &sl);
+    INSERT_BLOCK(r, tlsf, fl, sl);
+}
+
+/* 函数功能：逐步整理碎片。沿area_head的物理块链表前进，遇到“空闲块 + 未锁定句柄块”
+             就把句柄块向前滑动，空闲空间随之后移并与后面的空闲块合并。
+             整理位置保存在内存池中，下次调用从上次停下的地方继续
+   形参：   max_blocks  本次最多检查的块数（每次移动最多复制一个块的数据，时间有界）；
+            men_pool  内存池的首地址
+   返回：   本次移动的块数；完成一整遍后返回值为负（-1 - 移动块数），下次从头开始
+*/
+/******************************************************************/
+int compact_step_ex(int max_blocks, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    area_info_t *ai;
+    bhdr_t *b, *next_b;
+    int moved = 0;
+
+    if (!tlsf->hcount || POOL_POISONED(tlsf))
+        return -1;
+    while (max_blocks-- > 0) {
+        b = COMPACT_CURSOR(tlsf);
+        if (!b) {                   /* 从第一个内存区开始 */
+#if TLSF_QUICKLIST
+            quick_flush(tlsf);      /* 快速链表中的块看起来是已用的，会挡住句柄块 */
+#endif
+            ai = AREA_HEAD(tlsf);
+            LINK_SET(tlsf->cursor_area, ai);
+            SET_COMPACT_CURSOR(tlsf, (bhdr_t *) ((char *) ai - BHDR_OVERHEAD));
+            continue;
+        }
+        if (!(b->size & BLOCK_SIZE)) {  /* 内存区的末块，转到下一个内存区 */
+            ai = AREA_NEXT(LINK_GET(area_info_t, tlsf->cursor_area));
+            if (!ai) {
+                SET_COMPACT_CURSOR(tlsf, NULL);
+                return -1 - moved;
+            }
+            LINK_SET(tlsf->cursor_area, ai);
+            SET_COMPACT_CURSOR(tlsf, (bhdr_t *) ((char *) ai - BHDR_OVERHEAD));
+            continue;
+        }
+        next_b = GET_NEXT_BLOCK(b->ptr.buffer, b->size & BLOCK_SIZE);
+        if ((b->size & FREE_BLOCK) && (next_b->size & BLOCK_SIZE) && handle_movable(tlsf, next_b)) {
+            slide_block(tlsf, b, next_b);
+            moved++;                /* b现在是移动后的句柄块，下一步检查其后的空闲块 */
+            continue;
+        }
+        SET_COMPACT_CURSOR(tlsf, next_b);
+    }
+    return moved;
+}
+
+/*  默认内存池上的句柄接口，上锁后调用对应的*_ex函数*/
+/******************************************************************/
+tlsf_handle_t tlsf_halloc(size_t size)
+{
+/******************************************************************/
+    tlsf_handle_t h;
+
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+    h = halloc_ex(size, mp);
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+
+    if (!h)
+        mem_errorno = 0x01;
+    return h;
+}
+
+/******************************************************************/
+void tlsf_hfree(tlsf_handle_t h)
+{
+/******************************************************************/
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+    hfree_ex(h, mp);
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+}
+
+/******************************************************************/
+void *tlsf_hlock(tlsf_handle_t h)
+{
+/******************************************************************/
+    void *ret;
+
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+    ret = hlock_ex(h, mp);
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+    return ret;
+}
+
+/******************************************************************/
+void tlsf_hunlock(tlsf_handle_t h)
+{
+/******************************************************************/
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+    hunlock_ex(h, mp);
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+}
+
+/* 函数功能：在默认内存池上整理碎片，一次调用只在锁内检查max_blocks个块，
+             可在空闲任务中反复调用
+*/
+/******************************************************************/
+int tlsf_compact_step(int max_blocks)
+{
+/******************************************************************/
+    int ret;
+
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+    ret = compact_step_ex(max_blocks, mp);
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+    return ret;
+}
+#endif
+
+#if TLSF_WATERMARK
+/***************  内存水位 **************/
+
+#define WM_FREE_LOW     (0x1)
+#define WM_LARGEST_LOW  (0x2)
+
+/*  当前可保证分配成功的最大请求：最高非空大小类的下界（O(1)，只看位图）*/
+static size_t largest_free_class(tlsf_t *tlsf)
+{
+    int fl, sl;
+
+    if (!tlsf->fl_bitmap)
+        return 0;
+    fl = ms_bit(tlsf->fl_bitmap);
+    sl = ms_bit(tlsf->sl_bitmap[fl]);
+    if (fl == 0)
+        return (size_t) sl * (SMALL_BLOCK / MAX_SLI);
+    return ((size_t) 1 << (fl + FLI_OFFSET)) + ((size_t) sl << (fl + FLI_OFFSET - MAX_LOG2_SLI));
+}
+
+/*  越过低水位或回到高水位时通知一次（低/高水位之间不重复通知）*/
+static void watermark_check(tlsf_t *tlsf)
+{
+    tlsf_watermark_t *wm = &tlsf->wm;
+    size_t largest;
+
+    if (wm->free_low) {
+        if (!(tlsf->wm_state & WM_FREE_LOW) && tlsf->free_size < wm->free_low) {
+            tlsf->wm_state |= WM_FREE_LOW;
+            wm->notify(tlsf, TLSF_WM_FREE_LOW, wm->arg);
+        } else if ((tlsf->wm_state & WM_FREE_LOW) && tlsf->free_size >= wm->free_high) {
+            tlsf->wm_state &= ~WM_FREE_LOW;
+            wm->notify(tlsf, TLSF_WM_FREE_OK, wm->arg);
+        }
+    }
+    if (wm->largest_low) {
+        largest = largest_free_class(tlsf);
+        if (!(tlsf->wm_state & WM_LARGEST_LOW) && largest < wm->largest_low) {
+            tlsf->wm_state |= WM_LARGEST_LOW;
+            wm->notify(tlsf, TLSF_WM_LARGEST_LOW, wm->arg);
+        } else if ((tlsf->wm_state & WM_LARGEST_LOW) && largest >= wm->largest_high) {
+            tlsf->wm_state &= ~WM_LARGEST_LOW;
+            wm->notify(tlsf, TLSF_WM_LARGEST_OK, wm->arg);
+        }
+    }
+}
+
+/* 函数功能：设置内存池的水位与回调。回调在分配/释放函数内（持有内存池锁时）调用，
+             notify 只应记录状态或通知其他任务；reclaim 可以用 free_ex()（或递归锁下的
+             tlsf_free()）释放缓存，返回释放的字节数，返回0表示无法再释放
+   形参：   wm  水位设置（为0的水位不检查，高水位小于低水位时取低水位），NULL表示取消；
+            men_pool  内存池的首地址
+*/
+/******************************************************************/
+void set_watermark_ex(const tlsf_watermark_t *wm, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+
+    if (!wm) {
+        memset(&tlsf->wm, 0, sizeof(tlsf->wm));
+    } else {
+        tlsf->wm = *wm;
+        if (tlsf->wm.free_high < tlsf->wm.free_low)
+            tlsf->wm.free_high = tlsf->wm.free_low;
+        if (tlsf->wm.largest_high < tlsf->wm.largest_low)
+            tlsf->wm.largest_high = tlsf->wm.largest_low;
+    }
+    tlsf->wm_state = 0;
+    TLSF_WATERMARK_CHECK(tlsf);     /* 已经低于低水位时立即通知 */
+}
+
+/******************************************************************/
+size_t get_free_size(void *mem_pool)
+{
+/******************************************************************/
+    return ((tlsf_t *) mem_pool)->free_size;
+}
+
+/******************************************************************/
+void tlsf_set_watermark(const tlsf_watermark_t *wm)
+{
+/******************************************************************/
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *)mp)->lock);
+    set_watermark_ex(wm, mp);
+    TLSF_RELEASE_LOCK(&((tlsf_t *)mp)->lock);
+}
+#endif
+
+/***************  区域（bump）分配 **************/
+
+/* 区域向内存池申请的块，块之间按申请顺序反向链接，数据紧随其后 */
+struct tlsf_region_chunk {
+    struct tlsf_region_chunk *prev;
+    char *end;
+};
+
+#define REGION_HDR      ROUNDUP_SIZE(sizeof(struct tlsf_region_chunk))
+#define REGION_DATA(_c) ((char *) (_c) + REGION_HDR)
+
+/*  把区域链表中head之后（比stop新）的块都还给内存池*/
+static void region_free_chunks(tlsf_region_t *r, struct tlsf_region_chunk *stop)
+{
+    struct tlsf_region_chunk *c;
+
+    if (r->head == stop)
+        return;
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *) r->pool)->lock);
+    while (r->head != stop) {
+        c = r->head;
+        r->head = c->prev;
+        free_ex(c, r->pool);
+    }
+    TLSF_RELEASE_LOCK(&((tlsf_t *) r->pool)->lock);
+}
+
+/* 函数功能：初始化区域分配器。区域只属于一个使用者，tlsf_region_alloc() 不上锁，
+             只有向内存池申请/归还块时才对内存池上锁
+   形参：   r  区域； chunk_size  每次向内存池申请的块大小（大于它的请求单独申请一块）；
+            men_pool  内存池的首地址
+*/
+/******************************************************************/
+void tlsf_region_init(tlsf_region_t *r, size_t chunk_size, void *mem_pool)
+{
+/******************************************************************/
+    r->cur = r->end = NULL;
+    r->head = NULL;
+    r->chunk_size = chunk_size;
+    r->pool = mem_pool;
+}
+
+/* 函数功能：当前块不够时申请新块并从中分配，由tlsf_region_alloc()调用
+   形参：   size  已按TLSF_BLOCK_ALIGN对齐的大小
+   返回：   分配成功返回内存指针，内存池不足返回NULL（区域保持不变）
+*/
+/******************************************************************/
+void *tlsf_region_grow(tlsf_region_t *r, size_t size)
+{
+/******************************************************************/
+    struct tlsf_region_chunk *c;
+    size_t csize = r->chunk_size;
+
+    if (csize < size + REGION_HDR)
+        csize = size + REGION_HDR;
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *) r->pool)->lock);
+    c = (struct tlsf_region_chunk *) malloc_ex(csize, r->pool);
+    TLSF_RELEASE_LOCK(&((tlsf_t *) r->pool)->lock);
+    if (!c) {
+        mem_errorno = 0x01;
+        return NULL;
+    }
+    c->prev = r->head;
+    c->end = (char *) c + csize;
+    r->head = c;
+    r->cur = REGION_DATA(c) + size;
+    r->end = c->end;
+    return REGION_DATA(c);
+}
+
+/* 函数功能：退回到tlsf_region_mark()记下的位置，其后申请的块还给内存池
+*/
+/******************************************************************/
+void tlsf_region_release(tlsf_region_t *r, const tlsf_region_mark_t *m)
+{
+/******************************************************************/
+    region_free_chunks(r, m->head);
+    r->cur = m->cur;
+    r->end = m->head ? m->head->end : NULL;
+}
+
+/* 函数功能：释放区域中的全部分配，保留最早的一块供之后使用
+*/
+/******************************************************************/
+void tlsf_region_reset(tlsf_region_t *r)
+{
+/******************************************************************/
+    struct tlsf_region_chunk *first = r->head;
+
+    if (!first)
+        return;
+    while (first->prev)
+        first = first->prev;
+    region_free_chunks(r, first);
+    r->cur = REGION_DATA(first);
+    r->end = first->end;
+}
+
+/* 函数功能：释放区域的全部块，之后区域可继续使用（会重新申请块）
+*/
+/******************************************************************/
+void tlsf_region_destroy(tlsf_region_t *r)
+{
+/******************************************************************/
+    region_free_chunks(r, NULL);
+    r->cur = r->end = NULL;
+}
+
+/***************  中断中使用的无锁分配 **************/
+
+/* 中断中不能等待内存池的锁（target.h 在中断中直接跳过加锁），malloc_ex 不能在中断中调用。
+   tlsf_isr_t 缓存一些从内存池预先分配的同样大小的块，组成无锁栈（CAS）：
+   tlsf_isr_alloc()/tlsf_isr_free() 可在中断与任务中任意嵌套调用；
+   缓存低于低水位后由任务调用 tlsf_isr_refill() 从内存池补充。
+   栈顶 head 的低 q->off_bits 位为块相对 q->base（建立缓存时最低的内存区）的偏移
+   （以BLOCK_ALIGN为单位，0表示空），位数按各内存区覆盖的范围取最少，其余位为每次修改加1的标记，防止ABA（见TLSF_ISR_TAG_BITS）。
+   Cortex-M没有双字的LDREXD/STREXD，所以偏移与标记挤在一个字中。
+   块在缓存中时，第一个字存放下一块的偏移 */
+#define TLSF_ISR_SKIPS  (32)     /* 补充时最多跳过的其它内存区中的块 */
+
+#define ISR_OFF_MASK(_q)    (((size_t) 1 << (_q)->off_bits) - 1)
+#define ISR_TAG_ONE(_q)     ((size_t) 1 << (_q)->off_bits)
+
+#define ISR_OFF(_q, _p) ((size_t) ((char *) (_p) - (char *) (_q)->base) / BLOCK_ALIGN)
+#define ISR_PTR(_q, _o) ((void *) ((char *) (_q)->base + (_o) * BLOCK_ALIGN))
+
+static __inline__ int isr_cas(volatile size_t *ptr, size_t *old, size_t val)
+{
+    return __atomic_compare_exchange_n(ptr, old, val, 1, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+}
+
+static void isr_push(tlsf_isr_t *q, void *ptr)
+{
+    size_t old = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+
+    do {
+        *(size_t *) ptr = old & ISR_OFF_MASK(q);
+    } while (!isr_cas(&q->head, &old, ISR_OFF(q, ptr) | ((old & ~ISR_OFF_MASK(q)) + ISR_TAG_ONE(q))));
+    __atomic_fetch_add(&q->count, 1, __ATOMIC_RELAXED);
+}
+
+/* 函数功能：建立中断用的块缓存，并从内存池预先分配high块
+   形参：   q  缓存； size  块大小； low/high  低水位与补充目标； men_pool  内存池的首地址
+   返回：   成功返回0；内存池不足以预先分配high块，或内存区覆盖的范围太大、编码偏移后
+            标记不足TLSF_ISR_TAG_BITS位时返回-1。之后加入的、超出范围的内存区中的块不进缓存
+*/
+/******************************************************************/
+int tlsf_isr_init(tlsf_isr_t *q, size_t size, size_t low, size_t high, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_t *tlsf = (tlsf_t *) mem_pool;
+    area_info_t *ai;
+    char *lo = NULL, *hi = NULL;
+
+    /* 偏移要能表示现有各内存区中的块：add_new_area()加入的内存区可能在内存池之下，
+       以最低的内存区为基址，覆盖到最高的内存区末尾 */
+    TLSF_ACQUIRE_LOCK(&tlsf->lock);
+    for (ai = AREA_HEAD(tlsf); ai; ai = AREA_NEXT(ai)) {
+        if (!lo || (char *) ai - BHDR_OVERHEAD < lo)
+            lo = (char *) ai - BHDR_OVERHEAD;
+        if ((char *) AREA_END(ai) > hi)
+            hi = (char *) AREA_END(ai);
+    }
+    TLSF_RELEASE_LOCK(&tlsf->lock);
+    q->base = lo;
+    for (q->off_bits = 1; (size_t) (hi - lo) / BLOCK_ALIGN >> q->off_bits; q->off_bits++)
+        ;
+    if ((int) (sizeof(size_t) * CHAR_BIT) - q->off_bits < TLSF_ISR_TAG_BITS)
+        return -1;
+    q->head = 0;
+    q->count = 0;
+    q->low = low;
+    q->high = high;
+    q->size = size < sizeof(size_t) ? sizeof(size_t) : size;
+    q->pool = mem_pool;
+#if TLSF_MMAP_THRESHOLD
+    if (q->size >= TLSF_MMAP_THRESHOLD)     /* 单独映射的块不在内存池中 */
+        return -1;
+#endif
+    return tlsf_isr_refill(q) < high ? -1 : 0;
+}
+
+/* 函数功能：从缓存中取一块，无锁，可在中断中调用
+   返回：   块的地址（大小为q->size），缓存为空时返回NULL
+*/
+/******************************************************************/
+void *tlsf_isr_alloc(tlsf_isr_t *q)
+{
+/******************************************************************/
+    size_t old = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE), next;
+    void *ptr;
+
+    do {
+        if (!(old & ISR_OFF_MASK(q)))
+            return NULL;
+        ptr = ISR_PTR(q, old & ISR_OFF_MASK(q));
+        next = *(volatile size_t *) ptr;    /* 块可能已被别人取走，此时CAS失败，读到的值不用 */
+    } while (!isr_cas(&q->head, &old, (next & ISR_OFF_MASK(q)) | ((old & ~ISR_OFF_MASK(q)) + ISR_TAG_ONE(q))));
+    __atomic_fetch_sub(&q->count, 1, __ATOMIC_RELAXED);
+    return ptr;
+}
+
+/* 函数功能：把块还给缓存，无锁，可在中断中调用。
+             块也可以在任务中直接用 free_ex()/tlsf_free() 还给内存池
+*/
+/******************************************************************/
+void tlsf_isr_free(tlsf_isr_t *q, void *ptr)
+{
+/******************************************************************/
+    if (ptr)
+        isr_push(q, ptr);
+}
+
+/* 函数功能：从内存池补充缓存到high块，只能在任务中调用（会对内存池上锁）
+   返回：   补充的块数
+*/
+/******************************************************************/
+size_t tlsf_isr_refill(tlsf_isr_t *q)
+{
+/******************************************************************/
+    size_t n = 0;
+    void *ptr, *skipped = NULL;
+    int skips = 0;
+
+    if (q->count >= q->high)
+        return 0;
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *) q->pool)->lock);
+    while (q->count < q->high) {
+        if (!(ptr = malloc_ex(q->size, q->pool)))
+            break;
+        if (ISR_OFF(q, ptr) > ISR_OFF_MASK(q)) {    /* 在其它内存区，超出偏移的编码范围 */
+            if (++skips > TLSF_ISR_SKIPS) {
+                free_ex(ptr, q->pool);
+                break;
+            }
+            *(void **) ptr = skipped;   /* 先留着，免得下次又分到同一块 */
+            skipped = ptr;
+            continue;
+        }
+        isr_push(q, ptr);
+        n++;
+    }
+    while ((ptr = skipped)) {
+        skipped = *(void **) ptr;
+        free_ex(ptr, q->pool);
+    }
+    TLSF_RELEASE_LOCK(&((tlsf_t *) q->pool)->lock);
+    return n;
+}
+
+/* 函数功能：把缓存中的块全部还给内存池，只能在任务中调用，此后中断不能再使用q
+*/
+/******************************************************************/
+void tlsf_isr_destroy(tlsf_isr_t *q)
+{
+/******************************************************************/
+    void *ptr;
+
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *) q->pool)->lock);
+    while ((ptr = tlsf_isr_alloc(q)))
+        free_ex(ptr, q->pool);
+    TLSF_RELEASE_LOCK(&((tlsf_t *) q->pool)->lock);
+}
+
+/***************  实时任务的预留内存 **************/
+
+/* 函数功能：为一个任务预留内存。按大小类预先分出固定个数的槽，放在从内存池申请的一块内存中，
+             之后 tlsf_reserve_alloc()/tlsf_reserve_free() 只操作这些槽：不上内存池的锁，
+             不会因碎片而失败，时间为O(nclass)。同一时刻某类使用的槽不超过预留个数时，
+             分配保证成功。预留只属于一个任务（多个任务共用时由调用者互斥）
+   形参：   r  预留； sizes  各类槽的大小（从小到大）； counts  各类槽的个数；
+            nclass  类数（不超过TLSF_RESERVE_CLASSES）； men_pool  内存池的首地址
+   返回：   成功返回0；参数错误或内存池不足返回-1
+*/
+/******************************************************************/
+int tlsf_reserve_init(tlsf_reserve_t *r, const size_t *sizes, const size_t *counts, int nclass, void *mem_pool)
+{
+/******************************************************************/
+    tlsf_reserve_class_t *c;
+    size_t total = 0, i;
+    char *slot;
+    int n;
+
+    memset(r, 0, sizeof(*r));
+    if (nclass <= 0 || nclass > TLSF_RESERVE_CLASSES)
+        return -1;
+    for (n = 0; n < nclass; n++) {
+        c = &r->cls[n];
+        c->size = (sizes[n] < sizeof(void *)) ? sizeof(void *) : sizes[n];
+        c->size = (c->size + TLSF_BLOCK_ALIGN - 1) & ~(TLSF_BLOCK_ALIGN - 1);
+        if ((n && c->size <= r->cls[n - 1].size) || counts[n] > (SIZE_MAX - total) / c->size)
+            return -1;
+        total += c->size * counts[n];
+    }
+
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *) mem_pool)->lock);
+    r->mem = malloc_ex(total, mem_pool);
+    TLSF_RELEASE_LOCK(&((tlsf_t *) mem_pool)->lock);
+    if (!r->mem) {
+        mem_errorno = 0x01;
+        return -1;
+    }
+    r->pool = mem_pool;
+    r->nclass = nclass;
+
+    slot = (char *) r->mem;
+    for (n = 0; n < nclass; n++) {
+        c = &r->cls[n];
+        c->start = slot;
+        for (i = 0; i < counts[n]; i++, slot += c->size) {
+            *(void **) slot = c->free;
+            c->free = slot;
+        }
+        c->end = slot;
+        c->avail = counts[n];
+    }
+    return 0;
+}
+
+/* 函数功能：从预留中分配，取能容纳size的最小类（TLSF_RESERVE_BORROW时该类用完再试更大的类）
+   返回：   槽的地址；该类的预留用完或没有能容纳size的类时返回NULL
+*/
+/******************************************************************/
+void *tlsf_reserve_alloc(tlsf_reserve_t *r, size_t size)
+{
+/******************************************************************/
+    tlsf_reserve_class_t *c;
+    void *ptr;
+    int n;
+
+    for (n = 0; n < r->nclass; n++) {
+        c = &r->cls[n];
+        if (c->size < size)
+            continue;
+        if ((ptr = c->free)) {
+            c->free = *(void **) ptr;
+            c->avail--;
+            return ptr;
+        }
+        if (!TLSF_RESERVE_BORROW)
+            break;
+    }
+    return NULL;
+}
+
+/* 函数功能：把tlsf_reserve_alloc()得到的槽还给预留（不是还给内存池）
+*/
+/******************************************************************/
+void tlsf_reserve_free(tlsf_reserve_t *r, void *ptr)
+{
+/******************************************************************/
+    tlsf_reserve_class_t *c;
+    int n;
+
+    for (n = 0; n < r->nclass; n++) {
+        c = &r->cls[n];
+        if ((char *) ptr >= c->start && (char *) ptr < c->end) {
+            *(void **) ptr = c->free;
+            c->free = ptr;
+            c->avail++;
+            return;
+        }
+    }
+    if (ptr)
+        ERROR_MSG("tlsf_reserve_free (): %p is not a slot of this reservation\n", ptr);
+}
+
+/* 函数功能：取消预留，整块内存还给内存池（槽中的数据随之失效）
+*/
+/******************************************************************/
+void tlsf_reserve_destroy(tlsf_reserve_t *r)
+{
+/******************************************************************/
+    if (!r->mem)
+        return;
+    TLSF_ACQUIRE_LOCK(&((tlsf_t *) r->pool)->lock);
+    free_ex(r->mem, r->pool);
+    TLSF_RELEASE_LOCK(&((tlsf_t *) r->pool)->lock);
+    memset(r, 0, sizeof(*r));
+}
+
 void dm_init(void)
 {
 	init_memory_pool (DM_MEM_SIZE, work_mem);
@@ -1172,11 +4272,11 @@ void print_block(bhdr_t * b)
     else
         PRINT_MSG("sentinel, ");
     if ((b->size & BLOCK_STATE) == FREE_BLOCK)
-        PRINT_MSG("free [%p, %p], ", b->ptr.free_ptr.prev, b->ptr.free_ptr.next);
+        PRINT_MSG("free [%p, %p], ", FREE_PREV(b), FREE_NEXT(b));
     else
         PRINT_MSG("used, ");
     if ((b->size & PREV_STATE) == PREV_FREE)
-        PRINT_MSG("prev. free [%p])\n", b->prev_hdr);
+        PRINT_MSG("prev. free [%p])\n", PREV_HDR(b));
     else
         PRINT_MSG("prev used)\n");
 }
@@ -1188,18 +4288,18 @@ void print_tlsf(tlsf_t * tlsf)
 
     PRINT_MSG("\nTLSF at %p\n", tlsf);
 
-    PRINT_MSG("FL bitmap: 0x%x\n\n", (unsigned) tlsf->fl_bitmap);
+    PRINT_MSG("FL bitmap: 0x%llx\n\n", (unsigned long long) tlsf->fl_bitmap);
 
     for (i = 0; i < REAL_FLI; i++) {
         if (tlsf->sl_bitmap[i])
-            PRINT_MSG("SL bitmap 0x%x\n", (unsigned) tlsf->sl_bitmap[i]);
+            PRINT_MSG("SL bitmap 0x%llx\n", (unsigned long long) tlsf->sl_bitmap[i]);
         for (j = 0; j < MAX_SLI; j++) {
-            next = tlsf->matrix[i][j];
+            next = MATRIX(tlsf, i, j);
             if (next)
                 PRINT_MSG("-> [%d][%d]\n", i, j);
             while (next) {
                 print_block(next);
-                next = next->ptr.free_ptr.next;
+                next = FREE_NEXT(next);
             }
         }
     }
@@ -1213,18 +4313,18 @@ void print_tlsf_xbl(void)
     tlsf = (tlsf_t *) work_mem;
     PRINT_MSG("\nTLSF at %p\n", tlsf);
 
-    PRINT_MSG("FL bitmap: 0x%x\n\n", (unsigned) tlsf->fl_bitmap);
+    PRINT_MSG("FL bitmap: 0x%llx\n\n", (unsigned long long) tlsf->fl_bitmap);
 
     for (i = 0; i < REAL_FLI; i++) {
         if (tlsf->sl_bitmap[i])
-            PRINT_MSG("SL bitmap 0x%x\n", (unsigned) tlsf->sl_bitmap[i]);
+            PRINT_MSG("SL bitmap 0x%llx\n", (unsigned long long) tlsf->sl_bitmap[i]);
         for (j = 0; j < MAX_SLI; j++) {
-            next = tlsf->matrix[i][j];
+            next = MATRIX(tlsf, i, j);
             if (next)
                 PRINT_MSG("-> [%d][%d]\n", i, j);
             while (next) {
                 print_block(next);
-                next = next->ptr.free_ptr.next;
+                next = FREE_NEXT(next);
             }
         }
     }
@@ -1235,7 +4335,7 @@ void print_all_blocks(tlsf_t * tlsf)
     area_info_t *ai;
     bhdr_t *next;
     PRINT_MSG("\nTLSF at %p\nALL BLOCKS\n\n", tlsf);
-    ai = tlsf->area_head;
+    ai = AREA_HEAD(tlsf);
     while (ai) {
         next = (bhdr_t *) ((char *) ai - BHDR_OVERHEAD);
         while (next) {
@@ -1245,7 +4345,7 @@ void print_all_blocks(tlsf_t * tlsf)
             else
                 next = NULL;
         }
-        ai = ai->next;
+        ai = AREA_NEXT(ai);
     }
 }
 
@@ -1256,7 +4356,7 @@ void print_all_blocks_xbl(void)
     area_info_t *ai;
     bhdr_t *next;
     PRINT_MSG("\nTLSF at %p\nALL BLOCKS\n\n", tlsf);
-    ai = tlsf->area_head;
+    ai = AREA_HEAD(tlsf);
     while (ai) {
         next = (bhdr_t *) ((char *) ai - BHDR_OVERHEAD);
         while (next) {
@@ -1266,7 +4366,7 @@ void print_all_blocks_xbl(void)
             else
                 next = NULL;
         }
-        ai = ai->next;
+        ai = AREA_NEXT(ai);
     }
 }
 
@@ -22,8 +22,264 @@
 //#include <sys/types.h>
 #include <stddef.h>
 
+#ifdef __cplusplus
+extern "C" {
+#endif
+
 #define DM_MEM_SIZE    (8*1024) /*Size memory used by mem_alloc (in bytes)*/
 
+/* 大内存池模式（只用于64位主机）：位图为64位，一级索引默认覆盖到 2^41 字节 */
+#ifndef TLSF_LARGE_HEAP
+#define TLSF_LARGE_HEAP     (0)
+#endif
+
+/* 以下编译选项决定 tlsf.c 中有哪些函数，下面的函数原型也按它们声明。
+   与 TLSF_MAX_FLI 一样，包含 tlsf.h 的各个源文件必须使用与 tlsf.c 相同的设置 */
+
+/* 内存池内部链接使用相对偏移，内存池可以映射到不同地址（文件持久化、多进程共享）。
+   这样的内存池大小固定，不能与 USE_MMAP/USE_SBRK 同用 */
+#ifndef TLSF_PIC
+#define TLSF_PIC            (0)
+#endif
+
+/* 以文件映射的内存池（Linux），进程重启后重新映射即可继续使用，需要 TLSF_PIC */
+#ifndef TLSF_PERSIST
+#define TLSF_PERSIST        (0)
+#endif
+
+/* 多进程共享内存池（Linux POSIX shm），锁为进程间共享的robust pthread互斥量，需要 TLSF_PIC */
+#ifndef TLSF_SHM
+#define TLSF_SHM            (0)
+#endif
+
+/* 句柄方式分配的可移动内存块，以及逐步整理碎片的compact_step_ex() */
+#ifndef TLSF_HANDLE
+#define TLSF_HANDLE         (0)
+#endif
+
+/* 延迟合并：小于 1<<(TLSF_QUICK_FLI+FLI_OFFSET) 字节的块释放时不合并，按大小类放入快速链表，
+   同一大小类的下次分配直接取出。快速链表中的块最多 TLSF_QUICK_LIMIT 个，超出时、
+   分配找不到空闲块时或调用flush_quick_lists_ex()时才统一合并。
+   最坏情况：分配/释放仍为O(1)，只是触发合并的那一次要多处理 TLSF_QUICK_LIMIT 个块 */
+#ifndef TLSF_QUICKLIST
+#define TLSF_QUICKLIST      (0)
+#endif
+
+/* 内存水位：空闲字节数/最大可分配块低于低水位、回到高水位以上时回调通知，
+   分配失败时先调用回收回调再重试，见set_watermark_ex()。需要 TLSF_STATISTIC */
+#ifndef TLSF_WATERMARK
+#define TLSF_WATERMARK      (0)
+#endif
+
+/* 锁统计：加锁次数、竞争次数、等待/持有时间（TLSF_LOCK_CLOCK 的单位），见get_lock_stat_ex() */
+#ifndef TLSF_LOCK_STAT
+#define TLSF_LOCK_STAT      (0)
+#endif
+
+/* 阻塞分配：内存不足时malloc_wait_ex()/tlsf_malloc_wait()在内存池的等待队列上睡眠，
+   free_ex()/realloc_ex()释放出够用的空闲块时唤醒等待者。后端见target.h（RTX事件标志/pthread条件变量） */
+#ifndef TLSF_WAIT
+#define TLSF_WAIT           (0)
+#endif
+
+/* 分配器的几何参数，tlsf.c 中的 MAX_FLI/FLI_OFFSET 等由此得到，
+   tlsf.hpp 也用它们在编译期计算大小类。
+   TLSF_MAX_FLI 可以在编译时指定，最大块为 2^TLSF_MAX_FLI 字节 */
+#ifndef TLSF_MAX_FLI
+#if TLSF_LARGE_HEAP
+#define TLSF_MAX_FLI        (41)
+#else
+#define TLSF_MAX_FLI        (13)
+#endif
+#endif
+#define TLSF_FLI_OFFSET     (6)
+#define TLSF_REAL_FLI       (TLSF_MAX_FLI - TLSF_FLI_OFFSET)
+#define TLSF_MAX_LOG2_SLI   (5)
+#define TLSF_SMALL_BLOCK    (128)
+#define TLSF_BLOCK_ALIGN    (sizeof(void *) * 2)
+
+/* Per size class (fl, sl) counters, only kept when TLSF_STATISTIC_EXT is set */
+typedef struct tlsf_class_stat_struct {
+    size_t alloc_cnt;           /* successful malloc_ex */
+    size_t free_cnt;            /* free_ex */
+    size_t realloc_inplace_cnt; /* realloc_ex resized without moving */
+    size_t realloc_move_cnt;    /* realloc_ex fell back to malloc + memcpy */
+    size_t fail_cnt;            /* malloc_ex returned NULL */
+    size_t split_cnt;           /* a free block was split */
+    size_t merge_cnt;           /* free_ex merged with a neighbour */
+} tlsf_class_stat_t;
+
+/* One live sample of the heap profiler (TLSF_PROFILE), which only follows
+   the default pool (tlsf_malloc() and friends) */
+#ifndef TLSF_PROFILE_DEPTH
+#define TLSF_PROFILE_DEPTH  (4)
+#endif
+
+typedef struct tlsf_sample_struct {
+    void *ptr;                  /* sampled block */
+    size_t size;                /* requested size */
+    int depth;                  /* valid entries in callers[] */
+    void *callers[TLSF_PROFILE_DEPTH];
+} tlsf_sample_t;
+
+/* Timeout of malloc_wait_ex()/tlsf_malloc_wait() (TLSF_WAIT): kernel ticks
+   on RTX, milliseconds on hosts; 0 does not wait */
+#define TLSF_WAIT_FOREVER       ((unsigned long) -1)
+
+/* One entry of a warm start profile, see warm_pool_ex() */
+typedef struct tlsf_warm_struct {
+    size_t size;                /* request size */
+    size_t count;               /* free blocks of that size to prepare */
+} tlsf_warm_t;
+
+/* Lifetime hints for malloc_hint_ex() */
+#define TLSF_LIFE_SHORT         (0)
+#define TLSF_LIFE_LONG          (1)
+#define TLSF_LIFE_PERMANENT     (2)
+
+/* Lock statistics (TLSF_LOCK_STAT), times are in TLSF_LOCK_CLOCK() units */
+#define TLSF_LOCK_HIST          (24)
+
+typedef struct tlsf_lock_stat_struct {
+    unsigned long acquire_cnt;          /* outermost acquisitions */
+    unsigned long contended_cnt;        /* acquisitions that had to wait */
+    unsigned long long wait_time;       /* total / longest wait */
+    unsigned long long wait_max;
+    unsigned long long hold_time;       /* total / longest hold */
+    unsigned long long hold_max;
+    /* contended waits, bucket i counts waits in [2^i, 2^(i+1)) (bucket 0 includes 0),
+       the last bucket everything longer; gives the tail latency */
+    unsigned long wait_hist[TLSF_LOCK_HIST];
+} tlsf_lock_stat_t;
+
+/* Memory pressure events passed to tlsf_watermark_t.notify (TLSF_WATERMARK) */
+#define TLSF_WM_FREE_LOW        (1)     /* free bytes fell below free_low */
+#define TLSF_WM_FREE_OK         (2)     /* free bytes are back above free_high */
+#define TLSF_WM_LARGEST_LOW     (3)     /* largest allocatable block fell below largest_low */
+#define TLSF_WM_LARGEST_OK      (4)     /* largest allocatable block is back above largest_high */
+
+typedef struct tlsf_watermark_struct {
+    size_t free_low, free_high;         /* free bytes, 0 disables */
+    size_t largest_low, largest_high;   /* largest allocatable block, 0 disables */
+    void (*notify)(void *mem_pool, int event, void *arg);
+    /* Called when an allocation of size bytes fails, returns the bytes it released */
+    size_t (*reclaim)(void *mem_pool, size_t size, void *arg);
+    void *arg;
+} tlsf_watermark_t;
+
+/* 头文件中的内联函数（__inline 可用于 gcc/armcc/IAR） */
+#ifdef __cplusplus
+#define TLSF_INLINE         static inline
+#else
+#define TLSF_INLINE         static __inline
+#endif
+
+/* Region (bump) allocator carved from pool blocks, see tlsf_region_init() */
+struct tlsf_region_chunk;
+
+typedef struct tlsf_region_struct {
+    char *cur;                      /* next free byte in the head chunk */
+    char *end;                      /* end of the head chunk */
+    struct tlsf_region_chunk *head; /* newest chunk, chunks are chained backwards */
+    size_t chunk_size;              /* default chunk size (bytes) */
+    void *pool;
+} tlsf_region_t;
+
+/* Saved region position for tlsf_region_release() */
+typedef struct tlsf_region_mark_struct {
+    char *cur;
+    struct tlsf_region_chunk *head;
+} tlsf_region_mark_t;
+
+/* Reservation: fixed slots carved from a pool at startup, see tlsf_reserve_init() */
+#ifndef TLSF_RESERVE_CLASSES
+#define TLSF_RESERVE_CLASSES    (4)
+#endif
+
+typedef struct tlsf_reserve_class_struct {
+    size_t size;                /* slot size (bytes) */
+    char *start, *end;          /* slots of this class */
+    void *free;                 /* free slots, linked through their first word */
+    size_t avail;               /* number of free slots */
+} tlsf_reserve_class_t;
+
+typedef struct tlsf_reserve_struct {
+    void *pool;
+    void *mem;                  /* the block holding every slot */
+    int nclass;
+    tlsf_reserve_class_t cls[TLSF_RESERVE_CLASSES];
+} tlsf_reserve_t;
+
+/* Lock-free cache of pool blocks of one size, allocatable from interrupts,
+   see tlsf_isr_init().  head packs a block offset from base (off_bits
+   bits, just enough for the pool's areas) and an ABA tag in the
+   remaining bits.  The tag
+   wraps after 2^(word bits - off_bits) changes of head; a tlsf_isr_alloc()
+   preempted between its load and its CAS for exactly a multiple of that
+   many pushes/pops could pop a stale block.  tlsf_isr_init() refuses
+   pools that leave fewer than TLSF_ISR_TAG_BITS (default 16) tag bits:
+   on 32-bit targets, areas spanning up to 512 KB (65536 changes before a
+   wrap). */
+typedef struct tlsf_isr_struct {
+    volatile size_t head;
+    int off_bits;               /* offset bits in head */
+    volatile size_t count;      /* blocks in the cache */
+    size_t low, high;           /* refill below low, up to high */
+    size_t size;                /* block size (bytes) */
+    void *pool;
+    void *base;                 /* offsets count from here (lowest area) */
+} tlsf_isr_t;
+
+/* Heap snapshot written by write_snapshot_ex(), read by tlsf_snap.c on the host.
+ *
+ * Header (TLSF_SNAP_HDR_SIZE bytes): "TLSN", version, sizeof(void *),
+ *   block header overhead, block alignment, REAL_FLI, MAX_LOG2_SLI,
+ *   FLI_OFFSET, log2(SMALL_BLOCK), flags (TLSF_SNAP_TAGS), 3 reserved.
+ * Then records, every number is an unsigned LEB128 varint:
+ *   TLSF_SNAP_BITMAP  fl_bitmap, sl_bitmap[0 .. REAL_FLI-1]
+ *   TLSF_SNAP_STAT    used_size, max_size (0 without TLSF_STATISTIC)
+ *   TLSF_SNAP_AREA    zigzag(first block - pool), then one varint per block
+ *                     in address order: size | FREE(1) | PREV_FREE(2) | TAG(4),
+ *                     followed by the owner tag when TAG is set; the
+ *                     sentinel (size 0) closes the area
+ *   TLSF_SNAP_END
+ * Block addresses are implied: the next block starts size + overhead
+ * bytes after the current one. */
+#define TLSF_SNAP_HDR_SIZE      (16)
+#define TLSF_SNAP_VERSION       (1)
+#define TLSF_SNAP_TAGS          (0x1)   /* header flag: owner tags were asked for */
+
+#define TLSF_SNAP_END           (0)
+#define TLSF_SNAP_BITMAP        (1)
+#define TLSF_SNAP_STAT          (2)
+#define TLSF_SNAP_AREA          (3)
+
+#define TLSF_SNAP_FREE          (0x1)
+#define TLSF_SNAP_PREV_FREE     (0x2)
+#define TLSF_SNAP_TAG           (0x4)
+#define TLSF_SNAP_FLAGS         (0x7)
+
+/* Output callback of write_snapshot_ex(), returns non zero to abort */
+typedef int (*tlsf_snap_write_t)(const void *buf, size_t len, void *arg);
+/* Owner of a used block (e.g. a task id or a call site), 0 means untagged */
+typedef unsigned long (*tlsf_snap_tag_t)(void *ptr, void *arg);
+
+/* Handle of a movable block (TLSF_HANDLE), 0 is invalid */
+typedef int tlsf_handle_t;
+
+typedef struct tlsf_stat_struct {
+    size_t used_size;
+    size_t max_size;
+    size_t req_size;            /* total bytes asked for by malloc_ex/realloc_ex */
+    size_t grant_size;          /* total bytes handed out for those requests */
+    size_t sys_calls;           /* sbrk/mmap/munmap for pool areas (USE_MMAP/USE_SBRK) */
+    /* Estimate, not a count: the extra calls that fixed size areas of
+       max(request, DEFAULT_AREA_SIZE) would have needed, plus 2 for each
+       area reused from the cache (the munmap and mmap it replaced) */
+    size_t sys_saved;
+    tlsf_class_stat_t cls[TLSF_REAL_FLI][1 << TLSF_MAX_LOG2_SLI];  /* by (fl, sl) */
+} tlsf_stat_t;
+
 /**
  * Initiaize the dyn_mem module (work memory and other variables)
  */
@@ -32,17 +288,139 @@ void dm_init(void);
 extern size_t init_memory_pool(size_t, void *);
 extern size_t get_used_size(void *);
 extern size_t get_max_size(void *);
+extern void get_stat_info(void *, tlsf_stat_t *);
 extern void destroy_memory_pool(void *);
+#if TLSF_PIC
+extern void set_pool_root(void *, void *);
+extern void *get_pool_root(void *);
+extern size_t pool_ptr_to_offset(void *, void *);
+extern void *pool_offset_to_ptr(void *, size_t);
+#endif
+#if TLSF_PERSIST
+extern void *open_persistent_pool(const char *path, size_t size);
+extern void close_persistent_pool(void *);
+#endif
+#if TLSF_SHM
+extern void *open_shared_pool(const char *name, size_t size);
+extern void close_shared_pool(void *);
+#endif
 extern size_t add_new_area(void *, size_t, void *);
+extern size_t prefault_pool_ex(void *, int);
 extern void *malloc_ex(size_t, void *);
 extern void free_ex(void *, void *);
 extern void *realloc_ex(void *, size_t, void *);
+extern size_t try_expand_ex(void *, size_t, size_t, void *);
+extern size_t shrink_in_place_ex(void *, size_t, void *);
 extern void *calloc_ex(size_t, size_t, void *);
+extern void *memalign_ex(size_t, size_t, void *);
+extern void *malloc_class_ex(size_t, int, int, void *);
+extern void *malloc_hint_ex(size_t, int, void *);
+extern void *malloc_size_ex(size_t, size_t *, void *);
+#if TLSF_WAIT
+extern void *malloc_wait_ex(size_t, unsigned long, int, void *);
+#endif
+extern size_t warm_pool_ex(void *, const tlsf_warm_t *, int);
+#if TLSF_HANDLE
+extern int init_handle_table(int, void *);
+extern tlsf_handle_t halloc_ex(size_t, void *);
+extern void hfree_ex(tlsf_handle_t, void *);
+extern void *hlock_ex(tlsf_handle_t, void *);
+extern void hunlock_ex(tlsf_handle_t, void *);
+extern int compact_step_ex(int, void *);
+#endif
+#if TLSF_QUICKLIST
+extern int flush_quick_lists_ex(void *);
+#endif
+#if TLSF_WATERMARK
+extern void set_watermark_ex(const tlsf_watermark_t *, void *);
+extern size_t get_free_size(void *);
+#endif
+#if TLSF_LOCK_STAT
+extern void get_lock_stat_ex(void *, tlsf_lock_stat_t *, int);
+#endif
+extern size_t write_snapshot_ex(void *, tlsf_snap_write_t, tlsf_snap_tag_t, void *);
+extern int lock_memory_pool(void *);
+extern void unlock_memory_pool(void *);
+
+extern void tlsf_region_init(tlsf_region_t *, size_t, void *);
+extern void *tlsf_region_grow(tlsf_region_t *, size_t);
+extern void tlsf_region_release(tlsf_region_t *, const tlsf_region_mark_t *);
+extern void tlsf_region_reset(tlsf_region_t *);
+extern void tlsf_region_destroy(tlsf_region_t *);
+extern int tlsf_reserve_init(tlsf_reserve_t *, const size_t *, const size_t *, int, void *);
+extern void *tlsf_reserve_alloc(tlsf_reserve_t *, size_t);
+extern void tlsf_reserve_free(tlsf_reserve_t *, void *);
+extern void tlsf_reserve_destroy(tlsf_reserve_t *);
+extern int tlsf_isr_init(tlsf_isr_t *, size_t, size_t, size_t, void *);
+extern void *tlsf_isr_alloc(tlsf_isr_t *);
+extern void tlsf_isr_free(tlsf_isr_t *, void *);
+extern size_t tlsf_isr_refill(tlsf_isr_t *);
+extern void tlsf_isr_destroy(tlsf_isr_t *);
+
+/* 从区域中分配size字节（TLSF_BLOCK_ALIGN对齐），只有当前块用完时才进入内存池 */
+TLSF_INLINE void *tlsf_region_alloc(tlsf_region_t *r, size_t size)
+{
+    char *ptr = r->cur;
+
+    size = (size + TLSF_BLOCK_ALIGN - 1) & ~(TLSF_BLOCK_ALIGN - 1);
+    if (size > (size_t) (r->end - ptr))
+        return tlsf_region_grow(r, size);
+    r->cur = ptr + size;
+    return ptr;
+}
+
+/* 缓存低于低水位，需要在任务中调用 tlsf_isr_refill() */
+TLSF_INLINE int tlsf_isr_low(const tlsf_isr_t *q)
+{
+    return q->count < q->low;
+}
+
+/* 记下当前位置，之后的分配可由tlsf_region_release()一次退回，可嵌套 */
+TLSF_INLINE tlsf_region_mark_t tlsf_region_mark(const tlsf_region_t *r)
+{
+    tlsf_region_mark_t m;
+
+    m.cur = r->cur;
+    m.head = r->head;
+    return m;
+}
 
 extern void *tlsf_malloc(size_t size);
 extern void tlsf_free(void *ptr);
 extern void *tlsf_realloc(void *ptr, size_t size);
+extern size_t tlsf_try_expand(void *ptr, size_t min, size_t max);
+extern size_t tlsf_shrink_in_place(void *ptr, size_t size);
 extern void *tlsf_calloc(size_t nelem, size_t elem_size);
+extern void *tlsf_memalign(size_t align, size_t size);
+extern void *tlsf_malloc_class(size_t size, int fl, int sl);
+extern void *tlsf_malloc_hint(size_t size, int hint);
+extern void *tlsf_malloc_size(size_t size, size_t *granted);
+#if TLSF_WAIT
+extern void *tlsf_malloc_wait(size_t size, unsigned long timeout);
+#endif
+extern size_t tlsf_usable_size(void *ptr);
+extern void tlsf_get_stat(tlsf_stat_t *stat);
+extern void tlsf_profile_start(size_t interval);
+extern size_t tlsf_profile_dump(void (*cb)(const tlsf_sample_t *, void *), void *arg);
+#if TLSF_HANDLE
+extern tlsf_handle_t tlsf_halloc(size_t size);
+extern void tlsf_hfree(tlsf_handle_t h);
+extern void *tlsf_hlock(tlsf_handle_t h);
+extern void tlsf_hunlock(tlsf_handle_t h);
+extern int tlsf_compact_step(int max_blocks);
+#endif
+#if TLSF_QUICKLIST
+extern int tlsf_flush_quick(void);
+#endif
+#if TLSF_WATERMARK
+extern void tlsf_set_watermark(const tlsf_watermark_t *wm);
+#endif
+#if TLSF_LOCK_STAT
+extern void tlsf_get_lock_stat(tlsf_lock_stat_t *stat, int reset);
+#endif
+extern size_t tlsf_warm(const tlsf_warm_t *prof, int n);
+extern size_t tlsf_prefault(int nthreads);
+extern size_t tlsf_write_snapshot(tlsf_snap_write_t write, tlsf_snap_tag_t tag, void *arg);
 
 void print_tlsf_xbl(void);
 void print_all_blocks_xbl(void);
@@ -51,4 +429,8 @@ void print_all_blocks_xbl(void);
 #define dm_alloc tlsf_malloc
 #define dm_free tlsf_free
 #define dm_realloc tlsf_realloc
+
+#ifdef __cplusplus
+}
+#endif
 #endif
@@ -0,0 +1,336 @@
+/*
+ * C++ adapters for TLSF (header only)
+ *
+ *  - tlsf::synchronized_resource / tlsf::unsynchronized_resource :
+ *        std::pmr::memory_resource backed by one TLSF pool (C++17)
+ *  - tlsf::allocator<T, Pool> :
+ *        stateless std::allocator compatible template, the pool is
+ *        chosen at compile time through Pool (see tlsf::bound_pool)
+ *  - tlsf::object_pool<T> / tlsf::create<T>() / tlsf::destroy() :
+ *        typed allocation with the size class of sizeof(T) computed at
+ *        compile time (tlsf::size_class), going straight to
+ *        malloc_class_ex(); object_pool can also keep a few freed
+ *        objects on an intrusive free list
+ *
+ * Size and alignment are handed to memalign_ex(), so over-aligned types
+ * get a really aligned block instead of a padded one.
+ */
+
+#ifndef _TLSF_HPP_
+#define _TLSF_HPP_
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "tlsf.h"
+
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+
+namespace tlsf {
+
+namespace detail {
+
+/* 锁住内存池直到作用域结束，Synchronized为false时不做任何事 */
+template <bool Synchronized>
+struct pool_guard {
+    explicit pool_guard(void *mem_pool) noexcept : pool_(mem_pool) { lock_memory_pool(pool_); }
+    ~pool_guard() { unlock_memory_pool(pool_); }
+    pool_guard(const pool_guard &) = delete;
+    pool_guard &operator=(const pool_guard &) = delete;
+private:
+    void *pool_;
+};
+
+template <>
+struct pool_guard<false> {
+    explicit pool_guard(void *) noexcept {}
+};
+
+inline void *bad_alloc_or_null()
+{
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+    throw std::bad_alloc();
+#else
+    return nullptr;
+#endif
+}
+
+/* 与 tlsf.c 中 ms_bit() 相同，编译期版本 */
+constexpr int ms_bit(std::size_t x)
+{
+    return x <= 1 ? 0 : 1 + ms_bit(x >> 1);
+}
+
+constexpr std::size_t round_size(std::size_t r)
+{
+    return r < 2 * sizeof(void *) ? 2 * sizeof(void *)
+                                  : (r + TLSF_BLOCK_ALIGN - 1) & ~(TLSF_BLOCK_ALIGN - 1);
+}
+
+/* MAPPING_SEARCH 中 _r 增加的 _t 值 */
+constexpr std::size_t search_pad(std::size_t r)
+{
+    return (static_cast<std::size_t>(1) << (ms_bit(r) - TLSF_MAX_LOG2_SLI)) - 1;
+}
+
+} /* namespace detail */
+
+/* 编译期的 ROUNDUP_SIZE + MAPPING_SEARCH，结果与 malloc_ex() 中算出的完全一致 */
+template <std::size_t Size>
+struct size_class {
+private:
+    static constexpr std::size_t rounded = detail::round_size(Size);
+    static constexpr bool small = rounded < TLSF_SMALL_BLOCK;
+    static constexpr std::size_t padded = small ? rounded : rounded + detail::search_pad(rounded);
+    static constexpr int msb = detail::ms_bit(padded);
+
+public:
+    static constexpr std::size_t size = small ? rounded : padded & ~detail::search_pad(rounded);
+    static constexpr int fl = small ? 0 : msb - TLSF_FLI_OFFSET;
+    static constexpr int sl = small ? static_cast<int>(rounded / (TLSF_SMALL_BLOCK >> TLSF_MAX_LOG2_SLI))
+                                    : static_cast<int>(padded >> (msb - TLSF_MAX_LOG2_SLI)) - (1 << TLSF_MAX_LOG2_SLI);
+
+    static_assert(fl < TLSF_REAL_FLI, "size is out of the TLSF first-level range");
+};
+
+/* 编译期绑定的内存池：GetPool 返回 init_memory_pool() 初始化过的内存池首地址 */
+template <void *(*GetPool)(), bool Synchronized = true>
+struct bound_pool {
+    static void *allocate(std::size_t size, std::size_t align) noexcept
+    {
+        detail::pool_guard<Synchronized> guard(GetPool());
+        return memalign_ex(align, size, GetPool());
+    }
+
+    static void deallocate(void *ptr) noexcept
+    {
+        detail::pool_guard<Synchronized> guard(GetPool());
+        free_ex(ptr, GetPool());
+    }
+};
+
+/* 默认内存池，即 tlsf_malloc()/tlsf_free() 所用的内存池 */
+struct default_pool {
+    static void *allocate(std::size_t size, std::size_t align) noexcept
+    {
+        return tlsf_memalign(align, size);
+    }
+
+    static void deallocate(void *ptr) noexcept
+    {
+        tlsf_free(ptr);
+    }
+};
+
+template <class T, class Pool = default_pool>
+class allocator {
+public:
+    typedef T value_type;
+    typedef std::size_t size_type;
+    typedef std::ptrdiff_t difference_type;
+    typedef std::true_type is_always_equal;
+
+    template <class U>
+    struct rebind {
+        typedef allocator<U, Pool> other;
+    };
+
+    allocator() noexcept {}
+    template <class U>
+    allocator(const allocator<U, Pool> &) noexcept {}
+
+    T *allocate(std::size_t n)
+    {
+        void *ptr;
+
+        if (n > static_cast<std::size_t>(-1) / sizeof(T))
+            return static_cast<T *>(detail::bad_alloc_or_null());
+        if (!(ptr = Pool::allocate(n * sizeof(T), alignof(T))))
+            return static_cast<T *>(detail::bad_alloc_or_null());
+        return static_cast<T *>(ptr);
+    }
+
+#if defined(__cpp_lib_allocate_at_least)
+    /* 块中多出的空间也交给容器，见 tlsf_usable_size() */
+    std::allocation_result<T *> allocate_at_least(std::size_t n)
+    {
+        T *ptr = allocate(n);
+        return {ptr, ptr ? tlsf_usable_size(ptr) / sizeof(T) : 0};
+    }
+#endif
+
+    void deallocate(T *ptr, std::size_t) noexcept
+    {
+        Pool::deallocate(ptr);
+    }
+};
+
+template <class T, class U, class Pool>
+inline bool operator==(const allocator<T, Pool> &, const allocator<U, Pool> &) noexcept
+{
+    return true;
+}
+
+template <class T, class U, class Pool>
+inline bool operator!=(const allocator<T, Pool> &, const allocator<U, Pool> &) noexcept
+{
+    return false;
+}
+
+/* 从默认内存池构造/析构一个T对象，大小类在编译期确定 */
+template <class T, class... Args>
+inline T *create(Args &&... args)
+{
+    typedef size_class<sizeof(T)> cls;
+    static_assert(alignof(T) <= TLSF_BLOCK_ALIGN, "over-aligned type, use tlsf::allocator");
+
+    void *ptr = tlsf_malloc_class(cls::size, cls::fl, cls::sl);
+    if (!ptr)
+        return static_cast<T *>(detail::bad_alloc_or_null());
+    return new (ptr) T(std::forward<Args>(args)...);
+}
+
+template <class T>
+inline void destroy(T *obj)
+{
+    if (obj) {
+        obj->~T();
+        tlsf_free(obj);
+    }
+}
+
+/* 单一类型的对象池：
+   - 分配直接走 malloc_class_ex()，不再做 ROUNDUP_SIZE/MAPPING_SEARCH
+   - CacheMax > 0 时最多缓存 CacheMax 个释放的对象（链表指针放在对象内存中），
+     下次分配直接取出，不进入 TLSF
+   - Synchronized 为 true 时使用内存池自身的锁 */
+template <class T, std::size_t CacheMax = 0, bool Synchronized = true>
+class object_pool {
+    typedef size_class<sizeof(T)> cls;
+    static_assert(alignof(T) <= TLSF_BLOCK_ALIGN, "over-aligned type, use tlsf::allocator");
+
+    struct free_node {
+        free_node *next;
+    };
+
+public:
+    explicit object_pool(void *mem_pool) noexcept : pool_(mem_pool), cache_(nullptr), cached_(0) {}
+
+    ~object_pool() { trim(); }
+
+    object_pool(const object_pool &) = delete;
+    object_pool &operator=(const object_pool &) = delete;
+
+    void *allocate() noexcept
+    {
+        detail::pool_guard<Synchronized> guard(pool_);
+        if (cache_) {
+            free_node *node = cache_;
+            cache_ = node->next;
+            cached_--;
+            return node;
+        }
+        return malloc_class_ex(cls::size, cls::fl, cls::sl, pool_);
+    }
+
+    void deallocate(void *ptr) noexcept
+    {
+        if (!ptr)
+            return;
+        detail::pool_guard<Synchronized> guard(pool_);
+        if (cached_ < CacheMax) {
+            free_node *node = static_cast<free_node *>(ptr);
+            node->next = cache_;
+            cache_ = node;
+            cached_++;
+            return;
+        }
+        free_ex(ptr, pool_);
+    }
+
+    template <class... Args>
+    T *create(Args &&... args)
+    {
+        void *ptr = allocate();
+        if (!ptr)
+            return static_cast<T *>(detail::bad_alloc_or_null());
+        return new (ptr) T(std::forward<Args>(args)...);
+    }
+
+    void destroy(T *obj)
+    {
+        if (obj) {
+            obj->~T();
+            deallocate(obj);
+        }
+    }
+
+    /* 把缓存的对象全部还给内存池 */
+    void trim() noexcept
+    {
+        detail::pool_guard<Synchronized> guard(pool_);
+        while (cache_) {
+            free_node *node = cache_;
+            cache_ = node->next;
+            free_ex(node, pool_);
+        }
+        cached_ = 0;
+    }
+
+private:
+    void *pool_;
+    free_node *cache_;
+    std::size_t cached_;
+};
+
+#if __cplusplus >= 201703L
+
+/* 以一个TLSF内存池为后端的 memory_resource，内存池由调用者初始化与销毁 */
+template <bool Synchronized>
+class basic_resource : public std::pmr::memory_resource {
+public:
+    explicit basic_resource(void *mem_pool) noexcept : pool_(mem_pool) {}
+
+    void *pool() const noexcept { return pool_; }
+
+protected:
+    void *do_allocate(std::size_t bytes, std::size_t align) override
+    {
+        void *ptr;
+        {
+            detail::pool_guard<Synchronized> guard(pool_);
+            ptr = memalign_ex(align, bytes, pool_);
+        }
+        return ptr ? ptr : detail::bad_alloc_or_null();
+    }
+
+    void do_deallocate(void *ptr, std::size_t, std::size_t) override
+    {
+        detail::pool_guard<Synchronized> guard(pool_);
+        free_ex(ptr, pool_);
+    }
+
+    bool do_is_equal(const std::pmr::memory_resource &other) const noexcept override
+    {
+        return this == &other;
+    }
+
+private:
+    void *pool_;
+};
+
+/* 使用内存池自身的锁(TLSF_MLOCK_T)，可被多个线程共享 */
+typedef basic_resource<true> synchronized_resource;
+/* 不上锁，只用于单线程或由调用者保证互斥的内存池 */
+typedef basic_resource<false> unsynchronized_resource;
+
+#endif
+
+} /* namespace tlsf */
+
+#endif
@@ -0,0 +1,336 @@
+/*
+ * Host multi-thread benchmark of the locked default pool (Linux).
+ *
+ *   tlsf_bench [-t threads] [-n ops] [-m pool_mb]
+ *
+ * Every scenario runs with 1, 2, 4 ... up to -t threads (default: the
+ * number of online CPUs), each thread doing -n operations (default
+ * 200000) through tlsf_malloc/tlsf_free/tlsf_realloc:
+ *
+ *   local      thread-local churn: a window of live blocks per thread,
+ *              a random slot is freed and allocated again (16..512 bytes)
+ *   xfree      producer/consumer: every thread allocates into a ring read
+ *              by the next thread, which frees the blocks (cross-thread
+ *              free; with one thread the ring loops back to itself)
+ *   realloc    realloc-heavy mix: slots grow and shrink between 16 and
+ *              4096 bytes, with some malloc/free in between
+ *
+ * For each run the report gives the throughput (operations per second
+ * over all threads), the latency of one in 16 operations (p50, p99,
+ * p99.9 and max, in ns) and the get_lock_stat_ex() numbers of the pool:
+ * acquisitions, contended share, average/longest wait and hold, and the
+ * 99th percentile of the contended waits taken from wait_hist.
+ *
+ * Build on the host:
+ *   cc -O2 -DTLSF_PTHREAD=1 -DTLSF_LOCK_STAT=1 -DTLSF_MAX_FLI=30 -pthread \
+ *      -o tlsf_bench tlsf_bench.c tlsf.c
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tlsf.h"
+
+#if !TLSF_LOCK_STAT
+#error "tlsf_bench needs TLSF_LOCK_STAT"
+#endif
+
+#define BENCH_WINDOW    (256)   /* live blocks per thread */
+#define BENCH_RING      (1024)  /* producer/consumer ring, power of two */
+#define BENCH_SAMPLE    (16)    /* time one operation in BENCH_SAMPLE */
+#define BENCH_HIST      (40)    /* latency buckets, bucket i is [2^i, 2^(i+1)) ns */
+
+typedef unsigned long long u64_t;
+
+/* 单生产者单消费者环：生产者为前一个线程，消费者为本线程 */
+typedef struct bench_ring_struct {
+    void *slot[BENCH_RING];
+    volatile unsigned head;     /* written by the consumer */
+    volatile unsigned tail;     /* written by the producer */
+} bench_ring_t;
+
+typedef struct bench_thread_struct {
+    pthread_t tid;
+    int id;
+    unsigned seed;
+    u64_t ops;
+    u64_t hist[BENCH_HIST];     /* sampled operation latency */
+    bench_ring_t *in, *out;     /* xfree only */
+} bench_thread_t;
+
+typedef struct bench_struct {
+    const char *name;
+    void *(*fn)(void *);
+} bench_t;
+
+static long bench_ops = 200000;
+static int bench_nthreads;
+static pthread_barrier_t bench_start;
+static volatile int bench_producing;    /* xfree producers still running */
+
+static u64_t bench_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static unsigned bench_rand(bench_thread_t *t)
+{
+    t->seed = t->seed * 1103515245u + 12345u;
+    return t->seed >> 8;
+}
+
+static void bench_record(bench_thread_t *t, u64_t ns)
+{
+    int i;
+
+    for (i = 0; i < BENCH_HIST - 1 && (ns >> (i + 1)); i++)
+        ;
+    t->hist[i]++;
+}
+
+/* 每 BENCH_SAMPLE 次操作计时一次，避免读时钟的开销淹没分配本身 */
+#define BENCH_OP(t, i, op) do {	\
+        if (!((i) % BENCH_SAMPLE)) {	\
+            u64_t _t0 = bench_now();	\
+            op;	\
+            bench_record((t), bench_now() - _t0);	\
+        } else {	\
+            op;	\
+        }	\
+        (t)->ops++;	\
+    } while (0)
+
+static void *bench_local(void *arg)
+{
+    bench_thread_t *t = arg;
+    void *win[BENCH_WINDOW];
+    unsigned r;
+    long i;
+    int k;
+
+    memset(win, 0, sizeof(win));
+    pthread_barrier_wait(&bench_start);
+    for (i = 0; i < bench_ops; i++) {
+        r = bench_rand(t);
+        k = r % BENCH_WINDOW;
+        if (win[k]) {
+            BENCH_OP(t, i, tlsf_free(win[k]));
+            win[k] = NULL;
+        } else {
+            BENCH_OP(t, i, win[k] = tlsf_malloc(16 + (r >> 9) % 497));
+            if (win[k])
+                *(char *) win[k] = 1;
+        }
+    }
+    for (k = 0; k < BENCH_WINDOW; k++)
+        tlsf_free(win[k]);
+    return NULL;
+}
+
+/* 从自己的环中取出并释放，返回释放的个数 */
+static int bench_drain(bench_thread_t *t, long *i)
+{
+    bench_ring_t *q = t->in;
+    unsigned head = q->head;
+    int n = 0;
+
+    while (head != __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE)) {
+        void *ptr = q->slot[head & (BENCH_RING - 1)];
+
+        BENCH_OP(t, *i, tlsf_free(ptr));
+        (*i)++;
+        head++;
+        n++;
+    }
+    __atomic_store_n(&q->head, head, __ATOMIC_RELEASE);
+    return n;
+}
+
+static void *bench_xfree(void *arg)
+{
+    bench_thread_t *t = arg;
+    bench_ring_t *q = t->out;
+    unsigned tail;
+    void *ptr;
+    long i = 0, made = 0;
+
+    pthread_barrier_wait(&bench_start);
+    while (made < bench_ops / 2) {
+        tail = q->tail;
+        if (tail - __atomic_load_n(&q->head, __ATOMIC_ACQUIRE) == BENCH_RING) {
+            if (!bench_drain(t, &i))
+                sched_yield();  /* 下一个线程的环满了，自己的环也是空的 */
+            continue;
+        }
+        BENCH_OP(t, i, ptr = tlsf_malloc(16 + bench_rand(t) % 497));
+        i++;
+        if (!ptr)
+            continue;
+        *(char *) ptr = 1;
+        q->slot[tail & (BENCH_RING - 1)] = ptr;
+        __atomic_store_n(&q->tail, tail + 1, __ATOMIC_RELEASE);
+        made++;
+        if (!(made & 31))
+            bench_drain(t, &i);
+    }
+    __atomic_sub_fetch(&bench_producing, 1, __ATOMIC_ACQ_REL);
+    while (__atomic_load_n(&bench_producing, __ATOMIC_ACQUIRE))
+        if (!bench_drain(t, &i))
+            sched_yield();
+    bench_drain(t, &i);         /* 所有生产者都结束后最后一次 */
+    return NULL;
+}
+
+static void *bench_realloc(void *arg)
+{
+    bench_thread_t *t = arg;
+    void *win[BENCH_WINDOW], *ptr;
+    unsigned r;
+    long i;
+    int k;
+
+    memset(win, 0, sizeof(win));
+    pthread_barrier_wait(&bench_start);
+    for (i = 0; i < bench_ops; i++) {
+        r = bench_rand(t);
+        k = r % BENCH_WINDOW;
+        if (!win[k]) {
+            BENCH_OP(t, i, win[k] = tlsf_malloc(16 + (r >> 9) % 241));
+        } else if ((r >> 20) % 8 == 0) {
+            BENCH_OP(t, i, tlsf_free(win[k]));
+            win[k] = NULL;
+        } else {
+            BENCH_OP(t, i, ptr = tlsf_realloc(win[k], 16 + (r >> 9) % 4081));
+            if (ptr)
+                win[k] = ptr;
+        }
+    }
+    for (k = 0; k < BENCH_WINDOW; k++)
+        tlsf_free(win[k]);
+    return NULL;
+}
+
+static u64_t hist_pct(const u64_t *hist, int n, u64_t total, double pct)
+{
+    u64_t want = (u64_t) (total * pct), seen = 0;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        seen += hist[i];
+        if (hist[i] && seen >= want)
+            return (u64_t) 2 << i;      /* bucket upper bound */
+    }
+    return 0;
+}
+
+static void bench_run(void *pool, const bench_t *b, int nthreads)
+{
+    bench_thread_t *t = calloc(nthreads, sizeof(*t));
+    bench_ring_t *rings = calloc(nthreads, sizeof(*rings));
+    tlsf_lock_stat_t ls;
+    u64_t hist[BENCH_HIST], samples = 0, ops = 0, wait_hist[TLSF_LOCK_HIST], t0, t1;
+    int i, j;
+
+    if (!t || !rings) {
+        fprintf(stderr, "tlsf_bench: out of memory\n");
+        exit(1);
+    }
+    pthread_barrier_init(&bench_start, NULL, nthreads + 1);
+    bench_producing = nthreads;
+    get_lock_stat_ex(pool, &ls, 1);     /* 清零 */
+    for (i = 0; i < nthreads; i++) {
+        t[i].id = i;
+        t[i].seed = 12345u + 7919u * i;
+        t[i].in = &rings[i];
+        t[i].out = &rings[(i + 1) % nthreads];
+        pthread_create(&t[i].tid, NULL, b->fn, &t[i]);
+    }
+    pthread_barrier_wait(&bench_start);
+    t0 = bench_now();
+    for (i = 0; i < nthreads; i++)
+        pthread_join(t[i].tid, NULL);
+    t1 = bench_now();
+    get_lock_stat_ex(pool, &ls, 1);
+    pthread_barrier_destroy(&bench_start);
+
+    memset(hist, 0, sizeof(hist));
+    for (i = 0; i < nthreads; i++) {
+        ops += t[i].ops;
+        for (j = 0; j < BENCH_HIST; j++) {
+            hist[j] += t[i].hist[j];
+            samples += t[i].hist[j];
+        }
+    }
+    for (j = 0; j < TLSF_LOCK_HIST; j++)
+        wait_hist[j] = ls.wait_hist[j];
+
+    printf("%-8s %3d %12.0f %7llu %7llu %7llu %9llu   %10lu %6.1f%% %8.0f %9llu %8.0f %9llu %9llu\n",
+           b->name, nthreads, ops * 1e9 / (double) (t1 - t0),
+           hist_pct(hist, BENCH_HIST, samples, 0.5), hist_pct(hist, BENCH_HIST, samples, 0.99),
+           hist_pct(hist, BENCH_HIST, samples, 0.999), hist_pct(hist, BENCH_HIST, samples, 1.0),
+           ls.acquire_cnt, ls.acquire_cnt ? 100.0 * ls.contended_cnt / ls.acquire_cnt : 0.0,
+           ls.contended_cnt ? (double) ls.wait_time / ls.contended_cnt : 0.0, ls.wait_max,
+           ls.acquire_cnt ? (double) ls.hold_time / ls.acquire_cnt : 0.0, ls.hold_max,
+           hist_pct(wait_hist, TLSF_LOCK_HIST, ls.contended_cnt, 0.99));
+    free(t);
+    free(rings);
+}
+
+int main(int argc, char **argv)
+{
+    static const bench_t benches[] = {
+        {"local", bench_local},
+        {"xfree", bench_xfree},
+        {"realloc", bench_realloc},
+    };
+    size_t pool_size = (size_t) 64 << 20;
+    void *pool;
+    int c, n, i;
+
+    bench_nthreads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    while ((c = getopt(argc, argv, "t:n:m:")) != -1) {
+        switch (c) {
+        case 't':
+            bench_nthreads = atoi(optarg);
+            break;
+        case 'n':
+            bench_ops = atol(optarg);
+            break;
+        case 'm':
+            pool_size = (size_t) atol(optarg) << 20;
+            break;
+        default:
+            fprintf(stderr, "usage: tlsf_bench [-t threads] [-n ops] [-m pool_mb]\n");
+            return 2;
+        }
+    }
+    if (bench_nthreads < 1 || bench_ops < 2 || !pool_size) {
+        fprintf(stderr, "usage: tlsf_bench [-t threads] [-n ops] [-m pool_mb]\n");
+        return 2;
+    }
+
+    /* 成为默认内存池，tlsf_malloc() 等都在其上 */
+    if (!(pool = malloc(pool_size)) || init_memory_pool(pool_size, pool) == (size_t) -1) {
+        fprintf(stderr, "tlsf_bench: can not set up a %lu byte pool\n", (unsigned long) pool_size);
+        return 1;
+    }
+
+    printf("%d ops per thread, %lu MiB pool, times in ns\n\n", (int) bench_ops, (unsigned long) (pool_size >> 20));
+    printf("scenario thr      ops/s     p50     p99   p99.9       max     acquires   cont  avgwait   maxwait  avghold   maxhold   wait99\n");
+    for (i = 0; i < (int) (sizeof(benches) / sizeof(benches[0])); i++) {
+        for (n = 1; n < bench_nthreads; n *= 2)
+            bench_run(pool, &benches[i], n);
+        bench_run(pool, &benches[i], bench_nthreads);
+        printf("\n");
+    }
+    destroy_memory_pool(pool);
+    free(pool);
+    return 0;
+}
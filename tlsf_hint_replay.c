@@ -0,0 +1,346 @@
+/*
+ * Host trace replay of lifetime-hinted placement (see malloc_hint_ex()).
+ *
+ *   tlsf_hint_replay [-f trace] [-n events] [-r seed] [-m pool_kb]
+ *
+ * The same trace is replayed twice on a fresh pool of -m KB (default
+ * 1024): once with every allocation going through malloc_ex(), i.e. all
+ * of them treated as TLSF_LIFE_SHORT, and once through malloc_hint_ex()
+ * with the hint the trace gives.  For each policy the report gives
+ *
+ *   peak used     get_max_size() after the replay (0 without TLSF_STATISTIC)
+ *   min pool      the smallest pool (bisection in 1 KB steps) that
+ *                 replays the trace without a failed allocation, i.e. the
+ *                 peak heap the trace really needs under that policy
+ *   largest free  the largest free block, the lowest value seen every
+ *                 1024 events and at the end, taken from a snapshot
+ *                 (write_snapshot_ex())
+ *   failed        allocations that failed in the -m KB pool
+ *
+ * The trace file has one event per line:
+ *   a <id> <size> <hint>     allocate, hint 0 short, 1 long, 2 permanent
+ *   f <id>                   free the block allocated as <id>
+ * Ids are below the number of events.  Without -f a mixed workload of -n
+ * events (default 200000, seed -r) is generated: a window of short lived
+ * blocks (16..2048 bytes) that turns over on every event, long lived
+ * blocks (32..512 bytes) replaced one in 16 events and permanent blocks
+ * (64..256 bytes) added one in 256 events and never freed.
+ *
+ * Build on the host:
+ *   cc -O2 -DTLSF_PTHREAD=1 -DTLSF_MAX_FLI=24 -pthread \
+ *      -o tlsf_hint_replay tlsf_hint_replay.c tlsf.c
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "tlsf.h"
+
+#define REPLAY_SHORT    (64)    /* short lived window */
+#define REPLAY_LONG     (256)   /* long lived window */
+#define REPLAY_SAMPLE   (1024)  /* events between two largest free samples */
+
+typedef struct replay_event_struct {
+    char op;                    /* 'a' or 'f' */
+    unsigned char hint;
+    unsigned long id;
+    size_t size;
+} replay_event_t;
+
+typedef struct replay_result_struct {
+    size_t max_size;
+    size_t largest_min;         /* lowest largest free block seen */
+    size_t largest_end;         /* largest free block after the replay */
+    long failed;
+} replay_result_t;
+
+/* 快照缓冲区，write_snapshot_ex()的写回调追加到这里 */
+typedef struct replay_snap_struct {
+    unsigned char *buf;
+    size_t len, cap;
+} replay_snap_t;
+
+static replay_event_t *trace;
+static long trace_len, trace_cap;
+static void **live;
+static char *pool_mem;
+static replay_snap_t snap;
+
+static void trace_put(char op, unsigned long id, size_t size, int hint)
+{
+    if (trace_len == trace_cap) {
+        trace_cap = trace_cap ? 2 * trace_cap : 4096;
+        if (!(trace = realloc(trace, trace_cap * sizeof(*trace)))) {
+            fprintf(stderr, "tlsf_hint_replay: out of memory\n");
+            exit(1);
+        }
+    }
+    trace[trace_len].op = op;
+    trace[trace_len].id = id;
+    trace[trace_len].size = size;
+    trace[trace_len].hint = (unsigned char) hint;
+    trace_len++;
+}
+
+static size_t rand_size(unsigned *seed, size_t lo, size_t hi)
+{
+    return lo + (size_t) rand_r(seed) % (hi - lo + 1);
+}
+
+/* 生成混合负载：短生存期窗口每个事件换一块，长生存期每16个事件换一块，
+   永久块每256个事件加一块 */
+static void trace_generate(long n, unsigned seed)
+{
+    unsigned long short_id[REPLAY_SHORT], long_id[REPLAY_LONG], id = 0;
+    int short_live[REPLAY_SHORT], long_live[REPLAY_LONG], k;
+    long i;
+
+    memset(short_live, 0, sizeof(short_live));
+    memset(long_live, 0, sizeof(long_live));
+    for (i = 0; trace_len < n; i++) {
+        k = rand_r(&seed) % REPLAY_SHORT;
+        if (short_live[k])
+            trace_put('f', short_id[k], 0, 0);
+        short_id[k] = id++;
+        short_live[k] = 1;
+        trace_put('a', short_id[k], rand_size(&seed, 16, 2048), TLSF_LIFE_SHORT);
+        if (!(i % 16)) {
+            k = rand_r(&seed) % REPLAY_LONG;
+            if (long_live[k])
+                trace_put('f', long_id[k], 0, 0);
+            long_id[k] = id++;
+            long_live[k] = 1;
+            trace_put('a', long_id[k], rand_size(&seed, 32, 512), TLSF_LIFE_LONG);
+        }
+        if (!(i % 256))
+            trace_put('a', id++, rand_size(&seed, 64, 256), TLSF_LIFE_PERMANENT);
+    }
+}
+
+static int trace_read(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    char line[128], op;
+    unsigned long id, size;
+    int hint;
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, " %c %lu %lu %d", &op, &id, &size, &hint) == 4 && op == 'a'
+            && hint >= TLSF_LIFE_SHORT && hint <= TLSF_LIFE_PERMANENT)
+            trace_put('a', id, size, hint);
+        else if (sscanf(line, " %c %lu", &op, &id) == 2 && op == 'f')
+            trace_put('f', id, 0, 0);
+    }
+    fclose(f);
+    return 0;
+}
+
+static int snap_write(const void *buf, size_t len, void *arg)
+{
+    replay_snap_t *s = (replay_snap_t *) arg;
+
+    if (s->len + len > s->cap) {
+        s->cap = s->cap ? 2 * s->cap : 4096;
+        if (s->len + len > s->cap)
+            s->cap = s->len + len;
+        if (!(s->buf = realloc(s->buf, s->cap)))
+            return 1;
+    }
+    memcpy(s->buf + s->len, buf, len);
+    s->len += len;
+    return 0;
+}
+
+static unsigned long long snap_get(const unsigned char **p, const unsigned char *end)
+{
+    unsigned long long v = 0;
+    int shift = 0;
+
+    while (*p < end) {
+        v |= (unsigned long long) (**p & 0x7f) << shift;
+        shift += 7;
+        if (!(*(*p)++ & 0x80))
+            break;
+    }
+    return v;
+}
+
+/* 从快照中找出最大的空闲块，格式见 tlsf.h */
+static size_t largest_free(void *pool)
+{
+    const unsigned char *p, *end;
+    unsigned long long v;
+    size_t largest = 0;
+    int i, real_fli;
+
+    snap.len = 0;
+    if (!write_snapshot_ex(pool, snap_write, NULL, &snap))
+        return 0;
+    real_fli = snap.buf[8];
+    p = snap.buf + TLSF_SNAP_HDR_SIZE;
+    end = snap.buf + snap.len;
+    while (p < end) {
+        switch (snap_get(&p, end)) {
+        case TLSF_SNAP_BITMAP:
+            for (i = 0; i <= real_fli; i++)
+                snap_get(&p, end);
+            break;
+        case TLSF_SNAP_STAT:
+            snap_get(&p, end);
+            snap_get(&p, end);
+            break;
+        case TLSF_SNAP_AREA:
+            snap_get(&p, end);
+            do {
+                v = snap_get(&p, end);
+                if (v & TLSF_SNAP_TAG)
+                    snap_get(&p, end);
+                if ((v & TLSF_SNAP_FREE) && (v & ~(unsigned long long) TLSF_SNAP_FLAGS) > largest)
+                    largest = (size_t) (v & ~(unsigned long long) TLSF_SNAP_FLAGS);
+            } while ((v & ~(unsigned long long) TLSF_SNAP_FLAGS) && p < end);
+            break;
+        default:    /* TLSF_SNAP_END */
+            return largest;
+        }
+    }
+    return largest;
+}
+
+/* 在pool_kb大小的新内存池上重放整个轨迹，hinted为0时全部用malloc_ex() */
+static void replay(int hinted, size_t pool_kb, replay_result_t *r, int sample)
+{
+    void *pool = pool_mem;
+    size_t largest;
+    long i;
+
+    memset(r, 0, sizeof(*r));
+    r->largest_min = (size_t) -1;
+    memset(live, 0, trace_len * sizeof(*live));
+    if (init_memory_pool(pool_kb * 1024, pool) == (size_t) -1) {
+        r->failed = trace_len;
+        return;
+    }
+    for (i = 0; i < trace_len; i++) {
+        replay_event_t *e = &trace[i];
+
+        if (e->id >= (unsigned long) trace_len)
+            continue;
+        if (e->op == 'a') {
+            if (live[e->id])
+                free_ex(live[e->id], pool);
+            live[e->id] = hinted ? malloc_hint_ex(e->size, e->hint, pool) : malloc_ex(e->size, pool);
+            if (!live[e->id])
+                r->failed++;
+        } else if (live[e->id]) {
+            free_ex(live[e->id], pool);
+            live[e->id] = NULL;
+        }
+        if (sample && !(i % REPLAY_SAMPLE) && (largest = largest_free(pool)) < r->largest_min)
+            r->largest_min = largest;
+    }
+    r->max_size = get_max_size(pool);
+    if (sample) {
+        r->largest_end = largest_free(pool);
+        if (r->largest_end < r->largest_min)
+            r->largest_min = r->largest_end;
+    }
+    destroy_memory_pool(pool);
+}
+
+/* 二分查找能无失败重放轨迹的最小内存池（KB） */
+static size_t min_pool(int hinted, size_t pool_kb)
+{
+    replay_result_t r;
+    size_t lo = 1, hi = pool_kb, mid;
+
+    replay(hinted, hi, &r, 0);
+    if (r.failed)
+        return 0;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        replay(hinted, mid, &r, 0);
+        if (r.failed)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return hi;
+}
+
+int main(int argc, char **argv)
+{
+    static const char *name[2] = {"short only", "hinted"};
+    replay_result_t r[2];
+    size_t pool_kb = 1024, need[2];
+    const char *path = NULL;
+    unsigned seed = 1;
+    long n = 200000;
+    int c, h;
+
+    while ((c = getopt(argc, argv, "f:n:r:m:")) != -1) {
+        switch (c) {
+        case 'f':
+            path = optarg;
+            break;
+        case 'n':
+            n = atol(optarg);
+            break;
+        case 'r':
+            seed = (unsigned) atol(optarg);
+            break;
+        case 'm':
+            pool_kb = (size_t) atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: tlsf_hint_replay [-f trace] [-n events] [-r seed] [-m pool_kb]\n");
+            return 2;
+        }
+    }
+    if (n < 1 || pool_kb < 16) {
+        fprintf(stderr, "usage: tlsf_hint_replay [-f trace] [-n events] [-r seed] [-m pool_kb]\n");
+        return 2;
+    }
+    if (!path)
+        trace_generate(n, seed);
+    else if (trace_read(path))
+        return 1;
+    if (!trace_len) {
+        fprintf(stderr, "tlsf_hint_replay: empty trace\n");
+        return 1;
+    }
+    live = malloc(trace_len * sizeof(*live));
+    pool_mem = malloc(pool_kb * 1024);
+    if (!live || !pool_mem) {
+        fprintf(stderr, "tlsf_hint_replay: out of memory\n");
+        return 1;
+    }
+
+    printf("%ld events, %lu KB pool\n", trace_len, (unsigned long) pool_kb);
+    printf("%-12s %12s %12s %14s %14s %8s\n", "policy", "peak used", "min pool",
+           "largest (min)", "largest (end)", "failed");
+    for (h = 0; h < 2; h++) {
+        replay(h, pool_kb, &r[h], 1);
+        need[h] = min_pool(h, pool_kb);
+        printf("%-12s %12lu %9lu KB %14lu %14lu %8ld\n", name[h], (unsigned long) r[h].max_size,
+               (unsigned long) need[h], (unsigned long) r[h].largest_min,
+               (unsigned long) r[h].largest_end, r[h].failed);
+    }
+    if (need[0] && need[1])
+        printf("hinted placement needs %+ld KB (%+.1f%%) of pool\n", (long) need[1] - (long) need[0],
+               100.0 * ((double) need[1] - (double) need[0]) / (double) need[0]);
+    else
+        printf("min pool: the trace does not fit in %lu KB under every policy, raise -m\n",
+               (unsigned long) pool_kb);
+
+    free(snap.buf);
+    free(pool_mem);
+    free(live);
+    free(trace);
+    return 0;
+}
@@ -0,0 +1,206 @@
+/*
+ * Host stress test of the interrupt block cache (see tlsf_isr_init()),
+ * with POSIX signals standing in for interrupts (Linux).
+ *
+ *   tlsf_isr_test [-n ops] [-u usec] [-s size]
+ *
+ * The pool has a second area, added with add_new_area() below the pool
+ * itself, so the cache has to encode blocks of both.
+ *
+ * Two interval timers fire SIGALRM and SIGPROF every -u microseconds
+ * (default and minimum 20, with shorter periods the signals alone keep
+ * the CPU busy and the task hardly runs).  Their handlers do not block
+ * each other, so one can nest inside the other, like interrupts of two
+ * priorities.  Each handler keeps a few blocks, and on every tick frees
+ * the ones it holds (tlsf_isr_free) and takes new ones (tlsf_isr_alloc),
+ * checking the pattern it wrote into them.
+ *
+ * The main loop plays the task: -n operations (default 20000000) of
+ * tlsf_isr_alloc, tlsf_isr_free, tlsf_free of cache blocks straight back
+ * to the pool and tlsf_isr_refill when the cache runs low, all of which
+ * the signals interrupt at random points, also in the middle of the CAS
+ * loops.  A block handed out twice (ABA) or changed while cached shows
+ * up as a broken pattern.  At the end every block goes back to the pool
+ * and the pool must be as empty as before.
+ *
+ * Build on the host:
+ *   cc -O2 -DTLSF_PTHREAD=1 -DTLSF_STATISTIC=1 -DTLSF_MAX_FLI=21 -pthread \
+ *      -o tlsf_isr_test tlsf_isr_test.c tlsf.c
+ * (TLSF_MAX_FLI must cover the 128 KB areas.)
+ */
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include "tlsf.h"
+
+#define ISR_TEST_AREA   (128 * 1024)
+#define ISR_TEST_HELD   (8)     /* blocks a handler keeps between ticks */
+#define ISR_TEST_MINE   (16)    /* blocks the main loop keeps */
+#define ISR_TEST_LOW    (8)
+#define ISR_TEST_HIGH   (32)
+
+typedef struct isr_test_handler_struct {
+    void *held[ISR_TEST_HELD];
+    volatile long ops;
+    unsigned char mark;
+} isr_test_handler_t;
+
+static tlsf_isr_t isr_q;
+static size_t isr_size = 48;
+static volatile long isr_bad;
+static isr_test_handler_t isr_alrm = {{0}, 0, 0xA5}, isr_prof = {{0}, 0, 0x5A};
+/* 第二个内存区在前，内存池在后，中间留一段空隙 */
+static long isr_mem[3 * ISR_TEST_AREA / sizeof(long)];
+#define isr_pool    (&isr_mem[2 * ISR_TEST_AREA / sizeof(long)])
+
+/* 块的第一个字在缓存中存放下一块的偏移，图样从第二个字开始 */
+static void mark_block(void *ptr, unsigned char m)
+{
+    memset((char *) ptr + sizeof(size_t), m, isr_size - sizeof(size_t));
+}
+
+static int check_block(const void *ptr, unsigned char m)
+{
+    const unsigned char *p = (const unsigned char *) ptr + sizeof(size_t);
+    size_t i;
+
+    for (i = 0; i < isr_size - sizeof(size_t); i++)
+        if (p[i] != m)
+            return 0;
+    return 1;
+}
+
+static void isr_tick(isr_test_handler_t *h)
+{
+    int i;
+
+    for (i = 0; i < ISR_TEST_HELD; i++) {
+        if (h->held[i]) {
+            if (!check_block(h->held[i], h->mark))
+                isr_bad++;
+            tlsf_isr_free(&isr_q, h->held[i]);
+            h->held[i] = NULL;
+        } else if ((h->held[i] = tlsf_isr_alloc(&isr_q))) {
+            mark_block(h->held[i], h->mark);
+        }
+        h->ops++;
+    }
+}
+
+static void on_alrm(int sig)
+{
+    (void) sig;
+    isr_tick(&isr_alrm);
+}
+
+static void on_prof(int sig)
+{
+    (void) sig;
+    isr_tick(&isr_prof);
+}
+
+static void set_timers(long usec)
+{
+    struct itimerval it;
+
+    it.it_interval.tv_sec = it.it_value.tv_sec = 0;
+    it.it_interval.tv_usec = it.it_value.tv_usec = usec;
+    setitimer(ITIMER_REAL, &it, NULL);
+    setitimer(ITIMER_PROF, &it, NULL);
+}
+
+int main(int argc, char **argv)
+{
+    void *mine[ISR_TEST_MINE];
+    struct sigaction sa;
+    long n = 20000000, usec = 20, i, empty = 0;
+    size_t used0;
+    int c, k;
+
+    while ((c = getopt(argc, argv, "n:u:s:")) != -1) {
+        switch (c) {
+        case 'n':
+            n = atol(optarg);
+            break;
+        case 'u':
+            usec = atol(optarg);
+            break;
+        case 's':
+            isr_size = (size_t) atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: tlsf_isr_test [-n ops] [-u usec] [-s size]\n");
+            return 2;
+        }
+    }
+    if (n < 1 || usec < 20 || isr_size < 2 * sizeof(size_t) || isr_size > ISR_TEST_AREA / 64) {
+        fprintf(stderr, "usage: tlsf_isr_test [-n ops] [-u usec] [-s size]\n");
+        return 2;
+    }
+
+    if (init_memory_pool(ISR_TEST_AREA, isr_pool) == (size_t) -1) {
+        fprintf(stderr, "tlsf_isr_test: can not set up the pool\n");
+        return 1;
+    }
+    add_new_area(isr_mem, ISR_TEST_AREA, isr_pool);
+    used0 = get_used_size(isr_pool);
+    if (tlsf_isr_init(&isr_q, isr_size, ISR_TEST_LOW, ISR_TEST_HIGH, isr_pool)) {
+        fprintf(stderr, "tlsf_isr_test: tlsf_isr_init failed\n");
+        return 1;
+    }
+
+    memset(&sa, 0, sizeof(sa));
+    sigemptyset(&sa.sa_mask);   /* 两个处理函数可以互相嵌套 */
+    sa.sa_handler = on_alrm;
+    sigaction(SIGALRM, &sa, NULL);
+    sa.sa_handler = on_prof;
+    sigaction(SIGPROF, &sa, NULL);
+    set_timers(usec);
+
+    memset(mine, 0, sizeof(mine));
+    for (i = 0; i < n; i++) {
+        k = i % ISR_TEST_MINE;
+        if (mine[k]) {
+            if (!check_block(mine[k], 0x77))
+                isr_bad++;
+            if (i & ISR_TEST_MINE)
+                tlsf_isr_free(&isr_q, mine[k]);
+            else
+                tlsf_free(mine[k]);     /* 缓存的块也可以直接还给内存池 */
+            mine[k] = NULL;
+        } else if ((mine[k] = tlsf_isr_alloc(&isr_q))) {
+            mark_block(mine[k], 0x77);
+        } else {
+            empty++;
+        }
+        if (tlsf_isr_low(&isr_q))
+            tlsf_isr_refill(&isr_q);
+    }
+
+    set_timers(0);
+    signal(SIGALRM, SIG_IGN);
+    signal(SIGPROF, SIG_IGN);
+    for (k = 0; k < ISR_TEST_MINE; k++)
+        tlsf_isr_free(&isr_q, mine[k]);
+    for (k = 0; k < ISR_TEST_HELD; k++) {
+        tlsf_isr_free(&isr_q, isr_alrm.held[k]);
+        tlsf_isr_free(&isr_q, isr_prof.held[k]);
+    }
+    tlsf_isr_destroy(&isr_q);
+
+    printf("task ops %ld (cache empty %ld), handler ops %ld + %ld\n",
+           n, empty, isr_alrm.ops, isr_prof.ops);
+    printf("broken blocks %ld, pool used size changed by %ld\n", isr_bad,
+           (long) (get_used_size(isr_pool) - used0));
+    if (isr_bad || get_used_size(isr_pool) != used0) {
+        printf("FAIL\n");
+        return 1;
+    }
+    printf("ok\n");
+    return 0;
+}
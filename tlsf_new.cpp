@@ -0,0 +1,163 @@
+/*
+ * Optional replacement of the global C++ operator new/delete by TLSF.
+ *
+ * Link this file into the image to route every new/delete (plain,
+ * nothrow, sized and std::align_val_t variants) to the default pool
+ * (tlsf_malloc/tlsf_free).  If no default pool exists yet on first use it
+ * is set up with dm_init(), so objects constructed before main() are served
+ * as well; a pool the application made the default with init_memory_pool()
+ * is used as it is.  Deleting a null pointer never touches the pool.
+ *
+ * Sized delete forwards to tlsf_free(): free_ex() has to read the block
+ * header anyway to merge with the physical neighbours, so the size given
+ * by the compiler cannot save anything here.
+ * Aligned new uses tlsf_memalign(), which gives the unused head and tail
+ * of the block back to the pool instead of over-allocating.
+ */
+
+#include <cstddef>
+#include <new>
+
+#include "tlsf.h"
+
+extern "C" char *mp;            /* tlsf.c 中的默认内存池 */
+
+static inline void tlsf_new_init(void)
+{
+    if (!mp)                    /* 静态对象构造时还是单线程，不需要上锁 */
+        dm_init();
+}
+
+static inline void *tlsf_new_nothrow(std::size_t size, std::size_t align)
+{
+    void *ptr;
+
+    tlsf_new_init();
+    if (size == 0)
+        size = 1;
+    for (;;) {
+        ptr = align ? tlsf_memalign(align, size) : tlsf_malloc(size);
+        if (ptr)
+            return ptr;
+
+        std::new_handler handler = std::get_new_handler();
+        if (!handler)
+            return NULL;
+        handler();      /* new_handler 释放内存后再试一次 */
+    }
+}
+
+static inline void *tlsf_new(std::size_t size, std::size_t align)
+{
+    void *ptr = tlsf_new_nothrow(size, align);
+
+#if defined(__cpp_exceptions) || defined(__EXCEPTIONS)
+    if (!ptr)
+        throw std::bad_alloc();
+#endif
+    return ptr;
+}
+
+void *operator new(std::size_t size)
+{
+    return tlsf_new(size, 0);
+}
+
+void *operator new[](std::size_t size)
+{
+    return tlsf_new(size, 0);
+}
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept
+{
+    return tlsf_new_nothrow(size, 0);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept
+{
+    return tlsf_new_nothrow(size, 0);
+}
+
+void operator delete(void *ptr) noexcept
+{
+    tlsf_free(ptr);
+}
+
+void operator delete[](void *ptr) noexcept
+{
+    tlsf_free(ptr);
+}
+
+void operator delete(void *ptr, const std::nothrow_t &) noexcept
+{
+    tlsf_free(ptr);
+}
+
+void operator delete[](void *ptr, const std::nothrow_t &) noexcept
+{
+    tlsf_free(ptr);
+}
+
+#if __cpp_sized_deallocation
+void operator delete(void *ptr, std::size_t) noexcept
+{
+    tlsf_free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t) noexcept
+{
+    tlsf_free(ptr);
+}
+#endif
+
+#if __cpp_aligned_new
+void *operator new(std::size_t size, std::align_val_t align)
+{
+    return tlsf_new(size, static_cast<std::size_t>(align));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align)
+{
+    return tlsf_new(size, static_cast<std::size_t>(align));
+}
+
+void *operator new(std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+    return tlsf_new_nothrow(size, static_cast<std::size_t>(align));
+}
+
+void *operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+    return tlsf_new_nothrow(size, static_cast<std::size_t>(align));
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept
+{
+    tlsf_free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept
+{
+    tlsf_free(ptr);
+}
+
+void operator delete(void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    tlsf_free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t, const std::nothrow_t &) noexcept
+{
+    tlsf_free(ptr);
+}
+
+void operator delete(void *ptr, std::size_t, std::align_val_t) noexcept
+{
+    tlsf_free(ptr);
+}
+
+void operator delete[](void *ptr, std::size_t, std::align_val_t) noexcept
+{
+    tlsf_free(ptr);
+}
+#endif
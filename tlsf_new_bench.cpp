@@ -0,0 +1,151 @@
+/*
+ * Host benchmark of operator new/delete: TLSF (tlsf_new.cpp) against the
+ * system allocator.
+ *
+ * The same source is linked twice, once with tlsf_new.cpp and once
+ * without, and each binary times the same workloads:
+ *
+ *   fixed      new/delete of one 64 byte object in a loop
+ *   mixed      a window of live objects, a random slot is replaced by
+ *              an object of random size (8 .. 1024 bytes) every step
+ *   map        std::map insert/erase churn (node sized allocations)
+ *   vector     std::vector push_back growth, then drop (realloc pattern)
+ *   aligned    new/delete of an alignas(64) object
+ *
+ * Build on the host:
+ *   cc -O2 -DTLSF_PTHREAD=1 -DUSE_MMAP=1 -DTLSF_MAX_FLI=30 -c tlsf.c
+ *   c++ -O2 -std=c++17 -o new_tlsf tlsf_new_bench.cpp tlsf_new.cpp tlsf.o -pthread
+ *   c++ -O2 -std=c++17 -o new_sys tlsf_new_bench.cpp tlsf.o -pthread
+ *   ./new_sys; ./new_tlsf
+ *
+ * USE_MMAP lets the default pool grow beyond DM_MEM_SIZE.  The first
+ * output line tells which allocator served new.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <vector>
+
+#include "tlsf.h"
+
+extern "C" char *mp;            /* tlsf.c 中的默认内存池，只有经过tlsf_new.cpp才会建立 */
+
+#define BENCH_ROUNDS    (2000000)
+#define BENCH_WINDOW    (1024)
+
+struct alignas(64) bench_aligned {
+    char data[64];
+};
+
+/* 简单的线性同余随机数，两种分配器得到完全相同的请求序列 */
+static unsigned bench_seed = 1;
+
+static inline unsigned bench_rand(void)
+{
+    bench_seed = bench_seed * 1103515245u + 12345u;
+    return bench_seed >> 8;
+}
+
+/* 防止编译器把成对的new/delete优化掉 */
+static void *volatile bench_sink;
+
+static double bench_now(void)
+{
+    return std::chrono::duration<double, std::nano>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void bench_fixed(long n)
+{
+    for (long i = 0; i < n; i++) {
+        char *p = new char[64];
+        bench_sink = p;
+        delete[] p;
+    }
+}
+
+static void bench_mixed(long n)
+{
+    static char *win[BENCH_WINDOW];
+
+    for (long i = 0; i < n; i++) {
+        unsigned r = bench_rand();
+        char *&slot = win[r % BENCH_WINDOW];
+
+        delete[] slot;
+        slot = new char[8 + (r >> 10) % 1017];
+        slot[0] = 1;
+    }
+    for (int i = 0; i < BENCH_WINDOW; i++) {
+        delete[] win[i];
+        win[i] = nullptr;
+    }
+}
+
+static void bench_map(long n)
+{
+    std::map<unsigned, unsigned> m;
+
+    for (long i = 0; i < n; i++) {
+        unsigned k = bench_rand() % (4 * BENCH_WINDOW);
+
+        if (!m.erase(k))
+            m[k] = (unsigned) i;
+    }
+}
+
+static void bench_vector(long n)
+{
+    for (long i = 0; i < n; i += 4096) {
+        std::vector<long> v;
+
+        for (long j = 0; j < 4096; j++)
+            v.push_back(j);
+        bench_sink = v.data();
+    }
+}
+
+static void bench_aligned_new(long n)
+{
+    for (long i = 0; i < n; i++) {
+        bench_aligned *p = new bench_aligned;
+        bench_sink = p;
+        delete p;
+    }
+}
+
+static void bench_run(const char *name, void (*fn)(long), long n)
+{
+    double t0, t1;
+
+    fn(n / 16);                 /* 预热：内存池增长、系统分配器的缓存 */
+    t0 = bench_now();
+    fn(n);
+    t1 = bench_now();
+    std::printf("%-10s %10ld ops %10.1f ns/op\n", name, n, (t1 - t0) / n);
+}
+
+int main(int argc, char **argv)
+{
+    long n = (argc > 1) ? std::strtol(argv[1], NULL, 0) : BENCH_ROUNDS;
+    int *probe;
+
+    if (n <= 0) {
+        std::fprintf(stderr, "usage: %s [rounds]\n", argv[0]);
+        return 2;
+    }
+    probe = new int(0);
+    bench_sink = probe;
+    std::printf("allocator: %s\n", mp ? "tlsf" : "system");
+    delete probe;
+
+    bench_run("fixed", bench_fixed, n);
+    bench_run("mixed", bench_mixed, n);
+    bench_run("map", bench_map, n);
+    bench_run("vector", bench_vector, n);
+    bench_run("aligned", bench_aligned_new, n);
+    return 0;
+}
@@ -0,0 +1,471 @@
+/*
+ * Host side analyzer of TLSF heap snapshots (see write_snapshot_ex()).
+ *
+ *   tlsf_snap [-s size] snap          report one snapshot
+ *   tlsf_snap [-s size] old new       report the change between two
+ *   tlsf_snap -w snap                 print a warm start profile
+ *
+ * The report gives the used/free totals, the fragmentation index
+ * (1 - largest free block / free bytes), the share of free memory held
+ * in blocks smaller than -s bytes, the free block size distribution
+ * (power of two buckets), the bytes held by each owner tag and a check
+ * of the saved bitmaps against the free blocks found in the areas.
+ *
+ * With -w the used blocks of a snapshot taken in steady state are
+ * counted per size class and printed as a tlsf_warm_t table, hottest
+ * class first, ready to be compiled in and passed to warm_pool_ex().
+ *
+ * Build on the host: cc -O2 -o tlsf_snap tlsf_snap.c
+ * The geometry is read from the snapshot, so the tool does not need to
+ * be built with the TLSF_* options of the target.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tlsf.h"
+
+#define SNAP_HIST       (64)
+#define SNAP_TOP        (20)    /* owner tags listed in a report */
+
+typedef unsigned long long u64_t;
+
+typedef struct snap_block_struct {
+    long long off;              /* block header, relative to the pool */
+    u64_t size;
+    int flags;                  /* TLSF_SNAP_FREE | TLSF_SNAP_PREV_FREE */
+    int area;
+    u64_t tag;
+} snap_block_t;
+
+typedef struct snap_owner_struct {
+    u64_t tag;
+    u64_t blocks;
+    u64_t bytes;
+} snap_owner_t;
+
+typedef struct snap_struct {
+    const char *name;
+    unsigned char hdr[TLSF_SNAP_HDR_SIZE];
+    u64_t fl_bitmap;
+    u64_t sl_bitmap[64];
+    u64_t used_size, max_size;
+    int areas;
+    snap_block_t *blk;
+    size_t nblk, cap;
+
+    /* computed by snap_analyze() */
+    u64_t used, free, largest, small_free;
+    u64_t nused, nfree;
+    u64_t hist_cnt[SNAP_HIST], hist_bytes[SNAP_HIST];
+    snap_owner_t *own;
+    size_t nown;
+    int bad_bitmap;
+} snap_t;
+
+#define SNAP_OVERHEAD(s)    ((s)->hdr[6])
+#define SNAP_REAL_FLI(s)    ((s)->hdr[8])
+#define SNAP_LOG2_SLI(s)    ((s)->hdr[9])
+#define SNAP_FLI_OFFSET(s)  ((s)->hdr[10])
+#define SNAP_LOG2_SMALL(s)  ((s)->hdr[11])
+
+static void die(const char *name, const char *msg)
+{
+    fprintf(stderr, "tlsf_snap: %s: %s\n", name, msg);
+    exit(1);
+}
+
+static int msb(u64_t x)
+{
+    int i = -1;
+
+    while (x) {
+        x >>= 1;
+        i++;
+    }
+    return i;
+}
+
+static u64_t get_varint(const snap_t *s, const unsigned char **p, const unsigned char *end)
+{
+    u64_t v = 0;
+    int shift = 0;
+
+    do {
+        if (*p == end || shift > 63)
+            die(s->name, "truncated snapshot");
+        v |= (u64_t) (**p & 0x7f) << shift;
+        shift += 7;
+    } while (*(*p)++ & 0x80);
+    return v;
+}
+
+static void add_block(snap_t *s, const snap_block_t *b)
+{
+    if (s->nblk == s->cap) {
+        s->cap = s->cap ? s->cap * 2 : 1024;
+        s->blk = realloc(s->blk, s->cap * sizeof(*s->blk));
+        if (!s->blk)
+            die(s->name, "out of memory");
+    }
+    s->blk[s->nblk++] = *b;
+}
+
+static void snap_load(snap_t *s, const char *name)
+{
+    FILE *f;
+    unsigned char *data;
+    const unsigned char *p, *end;
+    long len;
+    u64_t v, rec;
+    snap_block_t b;
+    int i;
+
+    memset(s, 0, sizeof(*s));
+    s->name = name;
+    if (!(f = fopen(name, "rb")))
+        die(name, "cannot open");
+    fseek(f, 0, SEEK_END);
+    len = ftell(f);
+    rewind(f);
+    if (len < TLSF_SNAP_HDR_SIZE || !(data = malloc(len)) || fread(data, 1, len, f) != (size_t) len)
+        die(name, "cannot read");
+    fclose(f);
+
+    memcpy(s->hdr, data, TLSF_SNAP_HDR_SIZE);
+    if (memcmp(s->hdr, "TLSN", 4))
+        die(name, "not a TLSF snapshot");
+    if (s->hdr[4] != TLSF_SNAP_VERSION)
+        die(name, "unsupported snapshot version");
+    if (SNAP_REAL_FLI(s) > 64)
+        die(name, "bad header");
+
+    p = data + TLSF_SNAP_HDR_SIZE;
+    end = data + len;
+    while ((rec = get_varint(s, &p, end)) != TLSF_SNAP_END) {
+        switch (rec) {
+        case TLSF_SNAP_BITMAP:
+            s->fl_bitmap = get_varint(s, &p, end);
+            for (i = 0; i < SNAP_REAL_FLI(s); i++)
+                s->sl_bitmap[i] = get_varint(s, &p, end);
+            break;
+        case TLSF_SNAP_STAT:
+            s->used_size = get_varint(s, &p, end);
+            s->max_size = get_varint(s, &p, end);
+            break;
+        case TLSF_SNAP_AREA:
+            v = get_varint(s, &p, end);
+            b.off = (long long) (v >> 1) ^ -(long long) (v & 1);
+            b.area = s->areas++;
+            do {
+                v = get_varint(s, &p, end);
+                b.size = v & ~(u64_t) TLSF_SNAP_FLAGS;
+                b.flags = (int) (v & (TLSF_SNAP_FREE | TLSF_SNAP_PREV_FREE));
+                b.tag = (v & TLSF_SNAP_TAG) ? get_varint(s, &p, end) : 0;
+                if (b.size)
+                    add_block(s, &b);
+                b.off += (long long) (b.size + SNAP_OVERHEAD(s));
+            } while (b.size);
+            break;
+        default:
+            die(name, "unknown record");
+        }
+    }
+    free(data);
+}
+
+static void snap_free(snap_t *s)
+{
+    free(s->blk);
+    free(s->own);
+}
+
+/* 与 tlsf.c 中的 MAPPING_INSERT 相同 */
+static void mapping_insert(const snap_t *s, u64_t size, int *fl, int *sl)
+{
+    int sli = SNAP_LOG2_SLI(s);
+
+    if (size < ((u64_t) 1 << SNAP_LOG2_SMALL(s))) {
+        *fl = 0;
+        *sl = (int) (size / (((u64_t) 1 << SNAP_LOG2_SMALL(s)) >> sli));
+    } else {
+        *fl = msb(size);
+        *sl = (int) (size >> (*fl - sli)) - (1 << sli);
+        *fl -= SNAP_FLI_OFFSET(s);
+    }
+}
+
+/* 与 tlsf.c 中的 MAPPING_SEARCH 相同：不是类下界的大小向上取到下一个类 */
+static void mapping_search(const snap_t *s, u64_t size, int *fl, int *sl)
+{
+    if (size >= ((u64_t) 1 << SNAP_LOG2_SMALL(s)))
+        size += ((u64_t) 1 << (msb(size) - SNAP_LOG2_SLI(s))) - 1;
+    mapping_insert(s, size, fl, sl);
+}
+
+/* (fl,sl)的下界，即 MAPPING_SEARCH 后 malloc_ex() 实际取的大小 */
+static u64_t class_size(const snap_t *s, int fl, int sl)
+{
+    int sli = SNAP_LOG2_SLI(s);
+
+    if (fl == 0)
+        return (u64_t) sl * (((u64_t) 1 << SNAP_LOG2_SMALL(s)) >> sli);
+    fl += SNAP_FLI_OFFSET(s);
+    return ((u64_t) 1 << fl) + ((u64_t) sl << (fl - sli));
+}
+
+static int owner_cmp(const void *a, const void *b)
+{
+    const snap_owner_t *x = a, *y = b;
+
+    if (x->bytes != y->bytes)
+        return x->bytes < y->bytes ? 1 : -1;
+    return x->tag < y->tag ? -1 : x->tag > y->tag;
+}
+
+static snap_owner_t *find_owner(snap_t *s, u64_t tag)
+{
+    size_t i;
+
+    for (i = 0; i < s->nown; i++)
+        if (s->own[i].tag == tag)
+            return &s->own[i];
+    s->own = realloc(s->own, (s->nown + 1) * sizeof(*s->own));
+    if (!s->own)
+        die(s->name, "out of memory");
+    memset(&s->own[s->nown], 0, sizeof(*s->own));
+    s->own[s->nown].tag = tag;
+    return &s->own[s->nown++];
+}
+
+static void snap_analyze(snap_t *s, u64_t small)
+{
+    u64_t seen[64];
+    snap_owner_t *o;
+    size_t i;
+    int fl, sl;
+
+    memset(seen, 0, sizeof(seen));
+    for (i = 0; i < s->nblk; i++) {
+        const snap_block_t *b = &s->blk[i];
+
+        if (b->flags & TLSF_SNAP_FREE) {
+            s->nfree++;
+            s->free += b->size;
+            if (b->size > s->largest)
+                s->largest = b->size;
+            if (b->size < small)
+                s->small_free += b->size;
+            s->hist_cnt[msb(b->size)]++;
+            s->hist_bytes[msb(b->size)] += b->size;
+            mapping_insert(s, b->size, &fl, &sl);
+            if (fl >= 0 && fl < SNAP_REAL_FLI(s))
+                seen[fl] |= (u64_t) 1 << sl;
+        } else {
+            s->nused++;
+            s->used += b->size;
+            if (s->hdr[12] & TLSF_SNAP_TAGS) {
+                o = find_owner(s, b->tag);
+                o->blocks++;
+                o->bytes += b->size;
+            }
+        }
+    }
+    if (s->nown)
+        qsort(s->own, s->nown, sizeof(*s->own), owner_cmp);
+
+    /* 每个有空闲块的(fl,sl)都应在位图中置位，反之亦然 */
+    for (fl = 0; fl < SNAP_REAL_FLI(s); fl++) {
+        if (seen[fl] != s->sl_bitmap[fl])
+            s->bad_bitmap++;
+        if (!!seen[fl] != !!(s->fl_bitmap & ((u64_t) 1 << fl)))
+            s->bad_bitmap++;
+    }
+}
+
+static double frag_index(const snap_t *s)
+{
+    return s->free ? 1.0 - (double) s->largest / (double) s->free : 0.0;
+}
+
+static double small_share(const snap_t *s)
+{
+    return s->free ? (double) s->small_free / (double) s->free : 0.0;
+}
+
+static void snap_report(const snap_t *s, u64_t small)
+{
+    size_t i;
+
+    printf("%s: %d-bit, block overhead %u, alignment %u, %d area(s)\n",
+           s->name, s->hdr[5] * 8, SNAP_OVERHEAD(s), s->hdr[7], s->areas);
+    printf("  used     %12llu bytes in %llu blocks", s->used, s->nused);
+    if (s->max_size)
+        printf(" (statistic: used %llu, max %llu)", s->used_size, s->max_size);
+    printf("\n  free     %12llu bytes in %llu blocks, largest %llu\n", s->free, s->nfree, s->largest);
+    printf("  fragmentation index  %.3f\n", frag_index(s));
+    printf("  free in blocks < %llu  %.3f\n", small, small_share(s));
+    printf("  bitmaps  %s\n", s->bad_bitmap ? "MISMATCH" : "ok");
+
+    printf("\n  free block sizes       count         bytes\n");
+    for (i = 0; i < SNAP_HIST; i++)
+        if (s->hist_cnt[i])
+            printf("  [2^%-2u, 2^%-2u)  %12llu  %12llu\n", (unsigned) i, (unsigned) i + 1,
+                   s->hist_cnt[i], s->hist_bytes[i]);
+
+    if (s->nown) {
+        printf("\n  owner                 blocks         bytes\n");
+        for (i = 0; i < s->nown && i < SNAP_TOP; i++)
+            printf("  %-16llx  %10llu  %12llu\n", s->own[i].tag, s->own[i].blocks, s->own[i].bytes);
+        if (s->nown > SNAP_TOP)
+            printf("  ... %lu more\n", (unsigned long) (s->nown - SNAP_TOP));
+    }
+}
+
+static void diff_line(const char *what, u64_t a, u64_t b)
+{
+    printf("  %-14s %12llu -> %12llu  (%+lld)\n", what, a, b, (long long) (b - a));
+}
+
+static int delta_cmp(const void *a, const void *b)
+{
+    const snap_owner_t *x = a, *y = b;
+    long long dx = (long long) x->bytes, dy = (long long) y->bytes;
+
+    if (dx < 0)
+        dx = -dx;
+    if (dy < 0)
+        dy = -dy;
+    return dx < dy ? 1 : dx > dy ? -1 : 0;
+}
+
+static void snap_diff(snap_t *a, snap_t *b)
+{
+    snap_owner_t *d = NULL, *o;
+    size_t i, j, n = 0;
+
+    printf("%s -> %s\n", a->name, b->name);
+    diff_line("areas", a->areas, b->areas);
+    diff_line("used bytes", a->used, b->used);
+    diff_line("used blocks", a->nused, b->nused);
+    diff_line("free bytes", a->free, b->free);
+    diff_line("free blocks", a->nfree, b->nfree);
+    diff_line("largest free", a->largest, b->largest);
+    printf("  %-14s %12.3f -> %12.3f\n", "fragmentation", frag_index(a), frag_index(b));
+    printf("  %-14s %12.3f -> %12.3f\n", "small free", small_share(a), small_share(b));
+    if (a->bad_bitmap || b->bad_bitmap)
+        printf("  bitmaps        %s -> %s\n", a->bad_bitmap ? "MISMATCH" : "ok", b->bad_bitmap ? "MISMATCH" : "ok");
+
+    printf("\n  free block sizes       count\n");
+    for (i = 0; i < SNAP_HIST; i++)
+        if (a->hist_cnt[i] || b->hist_cnt[i])
+            printf("  [2^%-2u, 2^%-2u)  %8llu -> %8llu\n", (unsigned) i, (unsigned) i + 1,
+                   a->hist_cnt[i], b->hist_cnt[i]);
+
+    /* 按属主比较已用字节，变化最大的在前（找泄漏） */
+    if (!a->nown && !b->nown)
+        return;
+    d = calloc(a->nown + b->nown, sizeof(*d));
+    if (!d)
+        die(b->name, "out of memory");
+    for (i = 0; i < b->nown; i++)
+        d[n++] = b->own[i];
+    for (i = 0; i < a->nown; i++) {
+        o = NULL;
+        for (j = 0; j < b->nown; j++)
+            if (d[j].tag == a->own[i].tag)
+                o = &d[j];
+        if (!o) {
+            o = &d[n++];
+            o->tag = a->own[i].tag;
+        }
+        o->bytes -= a->own[i].bytes;
+        o->blocks -= a->own[i].blocks;
+    }
+    qsort(d, n, sizeof(*d), delta_cmp);
+    printf("\n  owner             blocks delta   bytes delta\n");
+    for (i = 0, j = 0; i < n && j < SNAP_TOP; i++) {
+        if (!d[i].bytes && !d[i].blocks)
+            continue;
+        printf("  %-16llx  %+12lld  %+12lld\n", d[i].tag, (long long) d[i].blocks, (long long) d[i].bytes);
+        j++;
+    }
+    free(d);
+}
+
+/* 已用块按大小类计数，借用 snap_owner_t：tag 为类的大小，blocks 为块数 */
+static void snap_warm(snap_t *s)
+{
+    snap_owner_t *w = NULL;
+    size_t i, j, nw = 0;
+    u64_t size;
+    int fl, sl;
+
+    for (i = 0; i < s->nblk; i++) {
+        if (s->blk[i].flags & TLSF_SNAP_FREE)
+            continue;
+        mapping_search(s, s->blk[i].size, &fl, &sl);  /* 与 malloc_ex() 查找的类一致 */
+        size = class_size(s, fl, sl);
+        for (j = 0; j < nw && w[j].tag != size; j++)
+            ;
+        if (j == nw) {
+            w = realloc(w, (nw + 1) * sizeof(*w));
+            if (!w)
+                die(s->name, "out of memory");
+            memset(&w[nw++], 0, sizeof(*w));
+            w[j].tag = size;
+        }
+        w[j].blocks++;
+        w[j].bytes += s->blk[i].size;
+    }
+    for (i = 0; i < nw; i++)            /* 按块数排序，热点在前 */
+        w[i].bytes = w[i].blocks;
+    if (nw)
+        qsort(w, nw, sizeof(*w), owner_cmp);
+
+    printf("/* warm start profile from %s */\n", s->name);
+    printf("static const tlsf_warm_t tlsf_warm_prof[] = {\n");
+    for (i = 0; i < nw; i++)
+        printf("    { %llu, %llu },\n", w[i].tag, w[i].blocks);
+    printf("};\n");
+    free(w);
+}
+
+int main(int argc, char **argv)
+{
+    snap_t a, b;
+    u64_t small = 256;
+    int i = 1, ret;
+
+    if (argc == 3 && !strcmp(argv[1], "-w")) {
+        snap_load(&a, argv[2]);
+        snap_warm(&a);
+        snap_free(&a);
+        return 0;
+    }
+    if (argc > 2 && !strcmp(argv[1], "-s")) {
+        small = strtoull(argv[2], NULL, 0);
+        i = 3;
+    }
+    if (argc - i < 1 || argc - i > 2) {
+        fprintf(stderr, "usage: tlsf_snap [-s size] snapshot [newer_snapshot]\n"
+                        "       tlsf_snap -w snapshot\n");
+        return 2;
+    }
+
+    snap_load(&a, argv[i]);
+    snap_analyze(&a, small);
+    if (argc - i == 1) {
+        snap_report(&a, small);
+        ret = a.bad_bitmap != 0;
+    } else {
+        snap_load(&b, argv[i + 1]);
+        snap_analyze(&b, small);
+        snap_diff(&a, &b);
+        ret = a.bad_bitmap || b.bad_bitmap;
+        snap_free(&b);
+    }
+    snap_free(&a);
+    return ret;
+}
@@ -0,0 +1,285 @@
+/*
+ * Host single-thread benchmark of the split policy (TLSF_TAIL_SPLIT).
+ *
+ *   tlsf_split_bench [-n ops] [-m pool_kb]
+ *
+ * The policy is chosen when tlsf.c is compiled, so build the program
+ * twice and run both on the same workload:
+ *   cc -O2 -DTLSF_PTHREAD=1 -DTLSF_MAX_FLI=24 -DTLSF_TAIL_SPLIT=0 -pthread \
+ *      -o tlsf_split_front tlsf_split_bench.c tlsf.c
+ *   cc -O2 -DTLSF_PTHREAD=1 -DTLSF_MAX_FLI=24 -DTLSF_TAIL_SPLIT=1 -pthread \
+ *      -o tlsf_split_tail tlsf_split_bench.c tlsf.c
+ * For the instruction count of the hot path run each one under
+ *   perf stat -e instructions,cycles ./tlsf_split_front
+ *
+ * Every scenario keeps a window of live blocks in a pool of -m KB
+ * (default 4096); each of the -n operations (default 2000000) frees a
+ * random slot or fills it again with malloc_ex()/free_ex(), no lock.
+ * The random sequence is fixed, so both builds see the same requests:
+ *
+ *   small      256 live blocks of 16..512 bytes
+ *   mixed      1024 live blocks of 16..4096 bytes
+ *
+ * For each scenario the report gives
+ *
+ *   ns/op, cycles/op   over the whole run (cycles from the TSC, x86 only)
+ *   peak used          get_max_size() (0 without TLSF_STATISTIC)
+ *   min pool           the smallest pool (bisection in 1 KB steps) that
+ *                      runs the scenario without a failed allocation
+ *   largest free       the largest free block, the lowest value seen
+ *                      every 4096 operations and at the end, taken from
+ *                      a snapshot (write_snapshot_ex())
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "tlsf.h"
+
+#ifndef TLSF_TAIL_SPLIT
+#define TLSF_TAIL_SPLIT     (0)     /* 与 tlsf.c 的缺省值相同 */
+#endif
+
+#define SPLIT_SAMPLE    (4096)  /* operations between two largest free samples */
+
+typedef unsigned long long u64_t;
+
+typedef struct split_scenario_struct {
+    const char *name;
+    int window;                 /* live blocks */
+    size_t min, max;            /* request sizes */
+} split_scenario_t;
+
+typedef struct split_result_struct {
+    u64_t ns, cycles;
+    size_t max_size;
+    size_t largest_min;         /* lowest largest free block seen */
+    size_t largest_end;         /* largest free block after the run */
+    long failed;
+} split_result_t;
+
+/* 快照缓冲区，write_snapshot_ex()的写回调追加到这里 */
+typedef struct split_snap_struct {
+    unsigned char *buf;
+    size_t len, cap;
+} split_snap_t;
+
+static long split_ops = 2000000;
+static char *pool_mem;
+static void **win;
+static split_snap_t snap;
+
+static u64_t split_now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (u64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static u64_t split_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static int snap_write(const void *buf, size_t len, void *arg)
+{
+    split_snap_t *s = (split_snap_t *) arg;
+
+    if (s->len + len > s->cap) {
+        s->cap = s->cap ? 2 * s->cap : 4096;
+        if (s->len + len > s->cap)
+            s->cap = s->len + len;
+        if (!(s->buf = realloc(s->buf, s->cap)))
+            return 1;
+    }
+    memcpy(s->buf + s->len, buf, len);
+    s->len += len;
+    return 0;
+}
+
+static u64_t snap_get(const unsigned char **p, const unsigned char *end)
+{
+    u64_t v = 0;
+    int shift = 0;
+
+    while (*p < end) {
+        v |= (u64_t) (**p & 0x7f) << shift;
+        shift += 7;
+        if (!(*(*p)++ & 0x80))
+            break;
+    }
+    return v;
+}
+
+/* 从快照中找出最大的空闲块，格式见 tlsf.h */
+static size_t largest_free(void *pool)
+{
+    const unsigned char *p, *end;
+    size_t largest = 0;
+    u64_t v;
+    int i, real_fli;
+
+    snap.len = 0;
+    if (!write_snapshot_ex(pool, snap_write, NULL, &snap))
+        return 0;
+    real_fli = snap.buf[8];
+    p = snap.buf + TLSF_SNAP_HDR_SIZE;
+    end = snap.buf + snap.len;
+    while (p < end) {
+        switch (snap_get(&p, end)) {
+        case TLSF_SNAP_BITMAP:
+            for (i = 0; i <= real_fli; i++)
+                snap_get(&p, end);
+            break;
+        case TLSF_SNAP_STAT:
+            snap_get(&p, end);
+            snap_get(&p, end);
+            break;
+        case TLSF_SNAP_AREA:
+            snap_get(&p, end);
+            do {
+                v = snap_get(&p, end);
+                if (v & TLSF_SNAP_TAG)
+                    snap_get(&p, end);
+                if ((v & TLSF_SNAP_FREE) && (v & ~(u64_t) TLSF_SNAP_FLAGS) > largest)
+                    largest = (size_t) (v & ~(u64_t) TLSF_SNAP_FLAGS);
+            } while ((v & ~(u64_t) TLSF_SNAP_FLAGS) && p < end);
+            break;
+        default:    /* TLSF_SNAP_END */
+            return largest;
+        }
+    }
+    return largest;
+}
+
+/* 在pool_kb大小的新内存池上运行一个场景，sample为0时不取快照（只数失败） */
+static void split_run(const split_scenario_t *s, size_t pool_kb, split_result_t *r, int sample)
+{
+    void *pool = pool_mem;
+    unsigned seed = 12345u;
+    size_t largest;
+    u64_t t0, c0;
+    long i;
+    int k;
+
+    memset(r, 0, sizeof(*r));
+    r->largest_min = (size_t) -1;
+    memset(win, 0, s->window * sizeof(*win));
+    if (init_memory_pool(pool_kb * 1024, pool) == (size_t) -1) {
+        r->failed = split_ops;
+        return;
+    }
+    t0 = split_now();
+    c0 = split_cycles();
+    for (i = 0; i < split_ops; i++) {
+        seed = seed * 1103515245u + 12345u;
+        k = (seed >> 8) % s->window;
+        if (win[k]) {
+            free_ex(win[k], pool);
+            win[k] = NULL;
+        } else if (!(win[k] = malloc_ex(s->min + (seed >> 12) % (s->max - s->min + 1), pool))) {
+            r->failed++;
+        }
+        if (sample && !(i % SPLIT_SAMPLE)) {
+            u64_t p0 = split_now(), q0 = split_cycles();
+
+            if ((largest = largest_free(pool)) < r->largest_min)
+                r->largest_min = largest;
+            t0 += split_now() - p0;     /* 取快照的时间不计入 */
+            c0 += split_cycles() - q0;
+        }
+    }
+    r->cycles = split_cycles() - c0;
+    r->ns = split_now() - t0;
+    r->max_size = get_max_size(pool);
+    if (sample) {
+        r->largest_end = largest_free(pool);
+        if (r->largest_end < r->largest_min)
+            r->largest_min = r->largest_end;
+    }
+    for (k = 0; k < s->window; k++)
+        free_ex(win[k], pool);
+    destroy_memory_pool(pool);
+}
+
+/* 二分查找能无失败运行场景的最小内存池（KB） */
+static size_t min_pool(const split_scenario_t *s, size_t pool_kb)
+{
+    split_result_t r;
+    size_t lo = 1, hi = pool_kb, mid;
+
+    split_run(s, hi, &r, 0);
+    if (r.failed)
+        return 0;
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        split_run(s, mid, &r, 0);
+        if (r.failed)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return hi;
+}
+
+int main(int argc, char **argv)
+{
+    static const split_scenario_t scenarios[] = {
+        {"small", 256, 16, 512},
+        {"mixed", 1024, 16, 4096},
+    };
+    split_result_t r;
+    size_t pool_kb = 4096, need;
+    int c, i;
+
+    while ((c = getopt(argc, argv, "n:m:")) != -1) {
+        switch (c) {
+        case 'n':
+            split_ops = atol(optarg);
+            break;
+        case 'm':
+            pool_kb = (size_t) atol(optarg);
+            break;
+        default:
+            fprintf(stderr, "usage: tlsf_split_bench [-n ops] [-m pool_kb]\n");
+            return 2;
+        }
+    }
+    if (split_ops < 1 || pool_kb < 16) {
+        fprintf(stderr, "usage: tlsf_split_bench [-n ops] [-m pool_kb]\n");
+        return 2;
+    }
+    pool_mem = malloc(pool_kb * 1024);
+    win = malloc(1024 * sizeof(*win));
+    if (!pool_mem || !win) {
+        fprintf(stderr, "tlsf_split_bench: out of memory\n");
+        return 1;
+    }
+
+    printf("%s split, %ld ops, %lu KB pool\n", TLSF_TAIL_SPLIT ? "tail" : "front", split_ops,
+           (unsigned long) pool_kb);
+    printf("scenario    ns/op cycles/op    peak used     min pool  largest (min)  largest (end)   failed\n");
+    for (i = 0; i < (int) (sizeof(scenarios) / sizeof(scenarios[0])); i++) {
+        split_run(&scenarios[i], pool_kb, &r, 1);
+        need = min_pool(&scenarios[i], pool_kb);
+        printf("%-8s %8.1f %9.1f %12lu %9lu KB %14lu %14lu %8ld\n", scenarios[i].name,
+               (double) r.ns / split_ops, (double) r.cycles / split_ops, (unsigned long) r.max_size,
+               (unsigned long) need, (unsigned long) r.largest_min, (unsigned long) r.largest_end, r.failed);
+    }
+
+    free(snap.buf);
+    free(win);
+    free(pool_mem);
+    return 0;
+}